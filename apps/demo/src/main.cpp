@@ -27,7 +27,9 @@ class demo_app : public app {
     std::filesystem::path assets_path;
 protected:
     std::shared_ptr<asset_bundle> load_assets() override {
-        return std::make_shared<asset_bundle>(assets_path);
+        return std::make_shared<asset_bundle>(
+            assets_path, bundle_load_options{.prefetch_gpu_data = true}
+        );
     }
 
     std::unique_ptr<rendering_algorithm> create_rendering_algorithm() override {
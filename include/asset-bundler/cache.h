@@ -0,0 +1,164 @@
+#pragma once
+#include "asset-bundler/model.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using std::byte;
+
+// SHA-256 over any number of pieces of data, so that cache keys are the same from run to run and
+// two different assets never share one
+struct content_hasher {
+    sha256 h;
+
+    void add(const void* data, size_t len) { h.add(data, len); }
+
+    template<typename T>
+    void add_value(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        add(&value, sizeof(T));
+    }
+
+    // hash the contents of a file, returning false if it could not be read
+    bool add_file(const path& file_path);
+
+    content_digest key() const { return h.digest(); }
+};
+
+// the header of a cached texture, which is followed by every processed mip level
+struct cached_texture_header {
+    // the decoded texture, before processing
+    int32_t        width, height, channels;
+    content_digest texel_digest;
+    // the processed texture
+    image_info img;
+    size_t     len;
+};
+
+// the header of a cached environment, which is followed by its processed skybox
+struct cached_environment_header {
+    image_info          skybox;
+    std::array<vec3, 9> diffuse_irradiance_sh;
+    size_t              len;
+};
+
+// the header of a cached model, which is followed by the imported model written by an
+// entry_writer
+struct cached_model_header {
+    size_t len;
+};
+
+// builds the data of an entry that has parts of varying length. vectors and strings are written
+// as their length followed by their elements
+class entry_writer {
+    std::vector<byte> bytes;
+
+  public:
+    template<typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto* p = (const byte*)&value;
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    template<typename T>
+    void write(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(values.size());
+        auto* p = (const byte*)values.data();
+        bytes.insert(bytes.end(), p, p + values.size() * sizeof(T));
+    }
+
+    void write(const std::string& s) {
+        write(s.size());
+        auto* p = (const byte*)s.data();
+        bytes.insert(bytes.end(), p, p + s.size());
+    }
+
+    const std::vector<byte>& data() const { return bytes; }
+};
+
+// reads the data of an entry in the same order that an entry_writer wrote it, throwing if it runs
+// past the end
+class entry_reader {
+    const byte *next, *end;
+
+    const byte* take(size_t len) {
+        if(len > (size_t)(end - next)) throw std::runtime_error("cache entry is too short");
+        auto* p = next;
+        next += len;
+        return p;
+    }
+
+  public:
+    entry_reader(const void* data, size_t len) : next((const byte*)data), end(next + len) {}
+
+    template<typename T>
+    void read(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        memcpy(&value, take(sizeof(T)), sizeof(T));
+    }
+
+    template<typename T>
+    void read(std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        size_t count;
+        read(count);
+        if(count > (size_t)(end - next) / sizeof(T))
+            throw std::runtime_error("cache entry is too short");
+        values.resize(count);
+        memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+    }
+
+    void read(std::string& s) {
+        size_t len;
+        read(len);
+        auto* p = take(len);
+        s.assign((const char*)p, len);
+    }
+};
+
+// an on-disk cache of processed assets, keyed by a hash of their source files and of the options
+// that change how they are processed, so that assets that have not changed are not processed again
+// entries are only ever read by the build of the bundler that wrote them, so they are raw structs.
+// each entry starts with a digest of the rest of it, so that a corrupt entry is never used
+class asset_cache {
+    path dir;
+
+    path entry_path(const content_digest& key) const;
+
+    // the entry stored for key without its digest, if there is one and the digest matches
+    std::optional<std::vector<byte>> load_bytes(const content_digest& key) const;
+
+  public:
+    asset_cache(path dir) : dir(std::move(dir)) {}
+
+    // the key for an asset, which starts with everything in opts that affects processed assets
+    content_hasher start_key(const options& opts) const;
+
+    // the entry stored for key, if there is a complete one, split into its header and its data
+    // the data is allocated with malloc for the caller to free
+    template<typename Header>
+    std::optional<std::pair<Header, stbi_uc*>> load(const content_digest& key) const {
+        auto entry = load_bytes(key);
+        if(!entry.has_value() || entry->size() < sizeof(Header)) return {};
+        Header header;
+        memcpy(&header, entry->data(), sizeof(Header));
+        if(entry->size() != sizeof(Header) + header.len) return {};
+        auto* data = (stbi_uc*)malloc(header.len);
+        memcpy(data, entry->data() + sizeof(Header), header.len);
+        return std::pair{header, data};
+    }
+
+    // store an entry made of a header followed by data, replacing any entry already stored for key
+    // failures are reported but otherwise ignored, since the assets can always be processed again
+    void store(
+        const content_digest& key,
+        const void*           header,
+        size_t                header_len,
+        const void*           data,
+        size_t                len
+    ) const;
+};
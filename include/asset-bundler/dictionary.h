@@ -0,0 +1,13 @@
+#pragma once
+#include "asset-bundler/model.h"
+
+using std::byte;
+
+// train a zstd dictionary on the contents of a set of existing bundles and write it to
+// output_path, so that similar bundles compressed with it are smaller and faster to decompress
+void train_dictionary(
+    const path& output_path, const std::vector<path>& bundle_paths, const options& opts
+);
+
+// read a trained dictionary, returning its contents and its id
+std::pair<std::vector<byte>, uint32_t> load_dictionary(const path& dictionary_path);
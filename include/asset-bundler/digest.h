@@ -0,0 +1,32 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// a SHA-256 digest, for hashes that are stored or that contents are identified by, where a
+// collision would silently swap one asset for another
+using content_digest = std::array<uint8_t, 32>;
+
+// SHA-256 over any number of pieces of data
+class sha256 {
+    uint32_t state[8];
+    uint8_t  block[64];
+    size_t   block_used = 0;
+    uint64_t total_len  = 0;
+
+    void compress(const uint8_t* data);
+
+  public:
+    sha256();
+
+    void add(const void* data, size_t len);
+
+    // the digest of everything added so far. more data can still be added afterwards
+    content_digest digest() const;
+};
+
+inline content_digest sha256_of(const void* data, size_t len) {
+    sha256 h;
+    h.add(data, len);
+    return h.digest();
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "asset-bundler/model.h"
+#include "asset-bundler/parallel.h"
+#include <array>
+
+// an equirectangular environment map in linear floating point
+struct equirect_map {
+    const float* data;
+    uint32_t     width, height;
+    int          nchannels;
+};
+
+// project an environment onto the 9 spherical harmonics up to l = 2, one RGB coefficient each.
+// rows of the map are spread over the workers
+std::array<vec3, 9> project_environment_sh(const equirect_map& src, worker_pool& workers);
+
+// the diffuse irradiance coefficients stored in environment_header: the projection above convolved
+// with the cosine lobe and divided by pi
+std::array<vec3, 9> diffuse_irradiance_sh(const equirect_map& src, worker_pool& workers);
+
+// render the skybox cubemap of an environment on the CPU into the same output as
+// environment_process_job makes on the GPU, laid out like copy_regions_for_linear_image2d
+void process_environment_on_cpu(
+    const environment_info& info, const equirect_map& src, uint8_t* dest, worker_pool& workers
+);
@@ -2,11 +2,13 @@
 #include "glm.h"
 #include <cstddef>
 #include <cstdint>
+#include <string_view>
 #include <vulkan/vulkan.hpp>
 
 using texture_id                 = uint16_t;
 const texture_id INVALID_TEXTURE = 0;
 using string_id                  = uint32_t;
+const string_id INVALID_STRING   = 0;
 using object_id                  = uint32_t;
 
 struct vertex {
@@ -21,18 +23,182 @@ constexpr static vk::VertexInputAttributeDescription vertex_attribute_descriptio
     {3, 0, vk::Format::eR32G32Sfloat,    offsetof(vertex, tex_coord)},
 };
 
+// compact vertex layout that bundles can use instead, less than half the size of vertex
+struct quantized_vertex {
+    // position within the mesh bounds, from 0 at the minimum to 65535 at the maximum, w is unused
+    uint16_t position[4];
+    // unit vectors in octahedral encoding
+    int16_t  normal[2], tangent[2];
+    // half floats
+    uint16_t tex_coord[2];
+};
+
+constexpr static vk::VertexInputAttributeDescription quantized_vertex_attribute_description[]{
+    {0, 0, vk::Format::eR16G16B16A16Unorm, offsetof(quantized_vertex, position) },
+    {1, 0, vk::Format::eR16G16Snorm,       offsetof(quantized_vertex, normal)   },
+    {2, 0, vk::Format::eR16G16Snorm,       offsetof(quantized_vertex, tangent)  },
+    {3, 0, vk::Format::eR16G16Sfloat,      offsetof(quantized_vertex, tex_coord)},
+};
+
 using index_type = uint32_t;
+// meshes with few enough vertices are drawn with 16-bit indices instead
+using short_index_type = uint16_t;
 
 namespace asset_bundle_format {
+// a bundle file is laid out as:
+//   file_header
+//   section_header[num_sections]     (uncompressed table of contents)
+//   frame_header[num_frames]         (uncompressed frame index)
+//   compressed frames...
+// the first section is always the CPU section, which contains the header below followed by all
+// the CPU-only tables and data. every other section contains GPU data, and is only decompressed
+// when it is needed.
+// each section is cut into frame_size chunks (the last one may be shorter) which are compressed as
+// independent frames, so that a loader can decompress them in any order on many threads. every
+// section picks its own codec, so data that is already compressed can be stored as is and data
+// that must load quickly can use LZ4 instead of zstd.
+// zstd frames may use a dictionary shared by many bundles, in which case the file header records
+// its id and the loader must be given the same dictionary.
+const uint32_t MAGIC   = 0x31316765;  // "eg11"
+const uint32_t VERSION = 10;
+
+const uint64_t DEFAULT_FRAME_SIZE = 1024 * 1024;
+
+struct file_header {
+    uint32_t magic, version;
+    uint64_t num_sections, num_frames;
+    // uncompressed size of every frame except the last one in each section
+    uint64_t frame_size;
+    // id of the zstd dictionary used to compress the frames, or 0 if there is none
+    uint64_t dictionary_id;
+};
+
+enum class section_type : uint32_t { cpu, texture, environment, vertices, indices, NUM_TYPES };
+
+enum class section_codec : uint32_t {
+    zstd,
+    // LZ4 blocks, which decode several times faster than zstd at a worse ratio
+    lz4,
+    // frames are stored uncompressed
+    stored,
+    NUM_CODECS
+};
+
+const char* const SECTION_CODEC_NAMES[] = {"zstd", "lz4", "stored"};
+
+// layout of every vertex in the vertices section
+enum class vertex_format : uint32_t {
+    // struct vertex
+    full,
+    // struct quantized_vertex, with positions relative to the bounds of the mesh they belong to
+    quantized
+};
+
+struct section_header {
+    section_type  type;
+    // texture id or environment index for the relevant section types, bytes per index for index
+    // sections
+    uint32_t      index;
+    section_codec codec;
+    uint32_t      reserved;
+    // range of the frame index that holds this section's data
+    uint64_t      first_frame, num_frames;
+    uint64_t      uncompressed_size;
+    // offset of the decompressed section in the GPU data (unused for the CPU section)
+    uint64_t      gpu_offset;
+};
+
+struct frame_header {
+    // location of the compressed frame from the start of the file
+    uint64_t file_offset, compressed_size;
+};
+
+// kinds of items that can be looked up by name through a name table in the header
+enum name_table_kind : uint32_t {
+    group_names,
+    object_names,
+    material_names,
+    texture_names,
+    NUM_NAME_TABLES
+};
+
+// a perfect hash table from names to item indices, built with hash-and-displace: the hash of a name
+// selects a bucket, and the bucket's seed is chosen when the bundle is written so that every name
+// in the table lands in its own slot. the seeds (uint32_t[num_buckets]) and slots
+// (name_slot[num_slots]) are stored in the CPU data.
+struct name_table {
+    uint32_t num_buckets, num_slots, seeds_offset, slots_offset;
+};
+
+struct name_slot {
+    // INVALID_STRING if the slot is empty
+    string_id name;
+    uint32_t  index;
+};
+
+// 64-bit FNV-1a
+inline uint64_t hash_name(std::string_view name) {
+    uint64_t h = 0xcbf29ce484222325;
+    for(char c : name) {
+        h ^= (uint8_t)c;
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+// remix a name hash with a bucket seed to choose a slot
+inline uint64_t name_slot_hash(uint64_t h, uint32_t seed) {
+    h ^= (uint64_t)seed * 0x9e3779b97f4a7c15;
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111eb;
+    return h ^ (h >> 31);
+}
+
+// a contiguous run of entries in one of the index tables
+struct index_range {
+    uint32_t first, count;
+};
+
+// object transforms are always affine, so the constant last row is dropped
+using affine_transform = glm::mat4x3;
+
+// the CPU section stores each kind of item as one or more tables of plain records, each starting
+// on a 16-byte boundary. objects and groups are split into parallel tables (structure of arrays)
+// so that walking one property, like all the bounds, only touches that property's memory.
+// offsets into CPU data are 32-bit and relative to the start of the CPU section. GPU data is
+// referred to either by section index plus a 32-bit offset within that section, or for the
+// geometry by a 64-bit offset into the GPU data, which is all GPU sections decompressed back to
+// back.
 struct header {
-    size_t num_strings, num_textures, num_materials, num_meshes, num_objects, num_groups,
-        num_environments, num_total_vertices, vertex_start_offset, num_total_indices,
-        index_start_offset, data_offset, gpu_data_offset;
+    uint32_t num_strings, num_textures, num_materials, num_meshes, num_objects, num_groups,
+        num_environments, num_total_vertices, num_total_indices, num_total_short_indices;
+
+    vertex_format vertex_layout;
+
+    // string_header[num_strings], followed by the raw string bytes they point into
+    uint32_t strings_offset;
+    // texture_header[num_textures], environment_header[num_environments],
+    // material_header[num_materials] and mesh_header[num_meshes]
+    uint32_t textures_offset, environments_offset, materials_offset, meshes_offset;
+    // string_id, affine_transform, aabb and index_range (into object_mesh_indices)[num_objects]
+    uint32_t object_names_offset, object_transforms_offset, object_bounds_offset,
+        object_meshes_offset;
+    // string_id, aabb and index_range (into group_object_indices)[num_groups]
+    uint32_t group_names_offset, group_bounds_offset, group_objects_offset;
+    // uint32_t[], object_id[]
+    uint32_t object_mesh_indices_offset, group_object_indices_offset;
+
+    name_table name_tables[NUM_NAME_TABLES];
+
+    // the 32-bit and 16-bit indices are in separate pools
+    uint64_t vertex_start_offset, index_start_offset, short_index_start_offset, gpu_data_size;
 };
 
 struct string_header {
-    string_id id;
-    size_t    offset, len;
+    // the string with id i is at index i - 1
+    uint32_t offset, len;
 };
 
 struct image {
@@ -44,43 +210,36 @@ struct texture_header {
     texture_id id;
     string_id  name;
     image      img;
-    size_t     offset;
+    // the texture data is the whole section
+    uint32_t   section;
 };
 
 struct environment_header {
     string_id name;
     image     skybox;
-    size_t    skybox_offset;
-    image     diffuse_irradiance;
-    size_t    diffuse_irradiance_offset;
+    // the skybox is the whole section
+    uint32_t  section;
+    // diffuse irradiance as spherical harmonic coefficients up to l = 2, already convolved with the
+    // cosine lobe and divided by pi, so evaluating them in direction n gives the radiance a white
+    // diffuse surface facing n reflects
+    vec3      diffuse_irradiance_sh[9];
 };
 
 struct mesh_header {
-    size_t vertex_offset, index_offset, index_count, material_index;
-    aabb   bounds;
+    // offsets and counts are in vertices/indices rather than bytes
+    uint32_t vertex_offset, index_offset, index_count, material_index;
+    aabb     bounds;
+    // bytes per index, which selects the index pool that index_offset points into
+    uint32_t index_size;
 };
 
 struct material_header {
     string_id  name;
-    texture_id base_color, normals, roughness, metallic;
+    // occlusion, roughness and metallic are packed into the R, G and B channels of one texture
+    texture_id base_color, normals, occlusion_roughness_metallic;
 
     material_header(string_id name)
         : name(name), base_color(INVALID_TEXTURE), normals(INVALID_TEXTURE),
-          roughness(INVALID_TEXTURE), metallic(INVALID_TEXTURE) {}
-};
-
-struct object_header {
-    string_id name;
-    uint32_t  num_meshes;
-    size_t    offset;
-    glm::mat4 transform_matrix;
-    aabb      bounds;
-};
-
-struct group_header {
-    string_id name;
-    uint32_t  num_objects;
-    size_t    offset;
-    aabb      bounds;
+          occlusion_roughness_metallic(INVALID_TEXTURE) {}
 };
 };  // namespace asset_bundle_format
@@ -1,40 +1,121 @@
 #pragma once
+#include "asset-bundler/cache.h"
 #include "asset-bundler/model.h"
 #include "asset-bundler/output_bundle.h"
+#include "asset-bundler/parallel.h"
 #include <assimp/Importer.hpp>
+#include <array>
 #include <assimp/postprocess.h>
 #include <optional>
 #include <stb_image.h>
+#include <string>
+#include <tuple>
 #include <utility>
+#include <vector>
+
+// the files a texture is loaded from
+struct texture_source {
+    path                main;
+    // opacity map to put in the alpha channel of an RGB main texture
+    std::optional<path> opacity;
+    texture_usage       usage = texture_usage::color;
+    // for packed occlusion/roughness/metallic textures, the single channel maps that go in R, G and
+    // B, any of which may be missing. main is then the first one present, which names the texture
+    std::array<std::optional<path>, 3> channels;
+
+    bool operator<(const texture_source& o) const {
+        return std::tie(main, opacity, usage, channels)
+               < std::tie(o.main, o.opacity, o.usage, o.channels);
+    }
+};
+
+// a texture after it has been decoded, ready to be added to a bundle
+struct decoded_texture {
+    int      width = 0, height = 0, channels = 0;
+    // null if the texture could not be loaded
+    stbi_uc* data       = nullptr;
+    // number of texels that were decoded, before the texture was possibly shrunk
+    size_t   num_texels = 0;
+    // log output from decoding, printed once the texture is added to the bundle
+    std::string messages;
+    double      decode_time = 0.0;
+    // digest of the decoded texels, used to find textures with identical contents
+    content_digest texel_digest = {};
+    // set if the asset cache is enabled, to store the processed texture under
+    std::optional<texture_cache_entry>   cache_entry;
+    // set if the processed texture was found in the asset cache, in which case data holds all of
+    // its mip levels
+    std::optional<cached_texture_header> processed;
+};
+
+// a model as a set of flat arrays, read from its file or found in the asset cache, that is ready to
+// be added to a bundle. string ids are indices into names, texture ids are one more than an index
+// into textures so that INVALID_TEXTURE still means none, and mesh, material and object indices
+// count from the model's own first one
+struct imported_model {
+    std::vector<vertex>        vertices;
+    std::vector<index_type>    indices;
+    std::vector<mesh_info>     meshes;
+    std::vector<material_info> materials;
+    std::vector<object_info>   objects;
+    std::vector<group_info>    groups;
+    std::vector<std::string>   names;
+    // every reference the materials make to a texture, in the order they make them. the paths are
+    // relative to the model's directory, so that a cached model can be moved
+    std::vector<texture_source> textures;
+    // log output from importing, printed once the model is added to the bundle
+    std::string messages;
+    // set if the model could not be read
+    std::optional<std::string> error;
+};
 
 class importer {
-    Assimp::Importer                                            aimp;
-    std::vector<path>                                           models;
-    std::map<texture_id, std::tuple<path, std::optional<path>>> textures;
-    std::vector<path>                                           environments;
+    Assimp::Importer                     aimp;
+    std::vector<path>                    models;
+    std::map<texture_id, texture_source> textures;
+    std::vector<path>                    environments;
+    // texture ids by source, so that a texture referenced by many materials is only loaded once
+    std::map<texture_source, texture_id> source_ids;
+    // number of additional times each texture was referenced after it was first added
+    std::map<texture_id, size_t>         duplicate_references;
 
     output_bundle& out;
+    unsigned       num_workers;
+    bool           optimize_meshes;
 
-    inline texture_id add_texture_path(std::filesystem::path p) {
-        auto id = out.reserve_texture_id();
-        textures.emplace(id, std::tuple<path, std::optional<path>>{p, {}});
-        return id;
-    }
+    // imported models and processed textures and environments from previous runs, if the cache is
+    // enabled
+    std::optional<asset_cache> cache;
+    // hash of the options, which every cache key starts from
+    content_hasher             cache_key_start;
 
-    void                       load_graph(const aiNode* node, aiMesh** meshInfos);
-    std::pair<object_id, aabb> load_object(const aiNode* node, aiMesh** meshInfos);
-    void                       load_group(const aiNode* node, aiMesh** meshInfos);
+    // reads models and decodes textures. declared last so that jobs still queued when loading
+    // throws are finished while everything they refer to is still alive
+    worker_pool workers;
 
-    void load_mesh(const aiMesh* m, const aiScene* scene, size_t mat_index_offset);
+    // returns the existing id if a texture has already been added from the same files
+    texture_id add_texture_source(texture_source src);
+
+    inline texture_id add_texture_path(
+        std::filesystem::path p, texture_usage usage = texture_usage::color
+    ) {
+        return add_texture_source(texture_source{.main = std::move(p), .usage = usage});
+    }
 
-    void load_model(const path& ip);
+    // add a model that has already been imported to the bundle
+    void add_model(const path& ip, imported_model&& model);
 
-    void load_texture(texture_id id, const std::tuple<path, std::optional<path>>& ip);
+    // decode every texture and submit it to the output bundle
+    void load_textures();
 
     void load_env(const path& ip);
 
   public:
-    importer(output_bundle& out, const std::vector<std::filesystem::path>& input_paths);
+    importer(
+        output_bundle&                            out,
+        const std::vector<std::filesystem::path>& input_paths,
+        const options&                            opts = {}
+    );
 
     void load();
 };
@@ -0,0 +1,17 @@
+#pragma once
+#include "asset-bundler/model.h"
+#include "asset-bundler/parallel.h"
+
+// generate the mip levels of an 8-bit unorm texture with one to four channels on the CPU. levels is
+// laid out like the texture processor reads levels back from the GPU (see
+// copy_regions_for_linear_image2d), tightly packed one after another, and must already hold the
+// top level. each level is made from the one above it, with its rows spread over the workers
+void generate_mip_chain(
+    uint8_t*     levels,
+    vk::Format   format,
+    uint32_t     width,
+    uint32_t     height,
+    uint32_t     mip_levels,
+    mip_filter   filter,
+    worker_pool& workers
+);
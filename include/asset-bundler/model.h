@@ -1,9 +1,12 @@
 #pragma once
+#include "asset-bundler/digest.h"
 #include "asset-bundler/format.h"
+#include <array>
 #include <assimp/scene.h>
 #include <filesystem>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <stb_image.h>
 #include <unordered_map>
 #include <unordered_set>
@@ -58,18 +61,56 @@ struct image_info {
     }
 };
 
+// what a texture is used for, which decides how it is block compressed
+enum class texture_usage {
+    // base colors, BC1 or BC7 if they have alpha
+    color,
+    // tangent space normals, BC5 which only keeps X and Y
+    normal_map,
+    // occlusion, roughness and metallic maps packed into R, G and B, BC7
+    occlusion_roughness_metallic
+};
+
+// identifies a decoded texture in the asset cache, with what is needed to deduplicate it without
+// decoding it again
+struct texture_cache_entry {
+    content_digest key;
+    int            width, height, channels;
+    content_digest texel_digest;
+};
+
+// how each mip level is made from the one above it
+enum class mip_filter {
+    // average each 2x2 square of texels, like a linear blit on the GPU
+    box,
+    // a separable Lanczos (a = 2) filter, which is sharper and aliases less, but only runs on
+    // the CPU
+    lanczos
+};
+
 struct texture_info {
-    texture_info(string_id name, uint32_t width, uint32_t height, vk::Format format, stbi_uc* data)
+    texture_info(
+        string_id     name,
+        uint32_t      width,
+        uint32_t      height,
+        vk::Format    format,
+        stbi_uc*      data,
+        texture_usage usage = texture_usage::color
+    )
         : name(name),
           img{.width = width, .height = height, .mip_levels = 0, .array_layers = 1, .format = format
           },
-          data(data) {}
+          data(data), usage(usage) {}
 
     string_id  name;
     image_info img;
-    // TODO: we can remove this since now it is on the GPU
-    stbi_uc* data;
-    size_t   len;
+    // the decoded texture, replaced by the processed texture once it is done. null while the
+    // texture is on the GPU
+    stbi_uc*      data;
+    size_t        len;
+    texture_usage usage;
+    // set if the processed texture should be stored in the asset cache
+    std::optional<texture_cache_entry> cache_entry;
 };
 
 struct environment_info {
@@ -77,13 +118,17 @@ struct environment_info {
     string_id name;
 
     // skybox cubemap
-    image_info skybox;
-    // diffuse irradiance cubemap
-    image_info diffuse_irradiance;
-    size_t     diffuse_irradiance_offset;
+    image_info          skybox;
+    // diffuse irradiance spherical harmonic coefficients, as in environment_header
+    std::array<vec3, 9> diffuse_irradiance_sh;
 
     // total length of all data
     size_t len;
+
+    // key to store the processed environment under in the asset cache
+    std::optional<content_digest> cache_key;
+    // the processed environment, if it was processed on the CPU or loaded from the asset cache
+    stbi_uc* data = nullptr;
 };
 
 inline vk::Format format_from_channels(int nchannels) {
@@ -114,11 +159,11 @@ using mesh_info = asset_bundle_format::mesh_header;
 
 struct material_info {
     string_id  name;
-    texture_id base_color, normals, roughness, metallic;
+    texture_id base_color, normals, occlusion_roughness_metallic;
 
     material_info(string_id name)
         : name(name), base_color(INVALID_TEXTURE), normals(INVALID_TEXTURE),
-          roughness(INVALID_TEXTURE), metallic(INVALID_TEXTURE) {}
+          occlusion_roughness_metallic(INVALID_TEXTURE) {}
 
     void set_texture(aiTextureType type, texture_id texture) {
 #define X(T, N)                                                                                    \
@@ -126,8 +171,6 @@ struct material_info {
         switch(type) {
             X(aiTextureType_DIFFUSE, base_color)
             X(aiTextureType_NORMALS, normals)
-            X(aiTextureType_METALNESS, metallic)
-            X(aiTextureType_SHININESS, roughness)
             default: throw std::runtime_error("unsupported texture type");
         }
 #undef X
@@ -148,5 +191,36 @@ struct group_info {
 };
 
 struct options {
-    bool enable_ibl_precomputation = false;
+    // number of models or textures read at once, 0 to use one per hardware thread
+    unsigned import_workers = 0;
+    // reorder mesh triangles and vertices so that they render faster
+    bool optimize_meshes = true;
+    // store textures block compressed according to their texture_usage
+    bool compress_textures = true;
+    // generate mip levels on the CPU even if there is a GPU to do it
+    bool       cpu_mips    = false;
+    mip_filter mips_filter = mip_filter::box;
+    // process environments on the CPU even if there is a GPU to do it
+    bool cpu_environments = false;
+    // write vertices as asset_bundle_format::vertex_format::quantized
+    bool quantize_vertices = false;
+    // directory of the asset cache, which is not used if empty
+    path cache_dir;
+
+    // zstd compression level, if unset the fastest level is used which is best for iteration
+    std::optional<int> compression_level;
+    // number of threads compressing frames at once, 0 to use one per hardware thread
+    unsigned compression_workers    = 0;
+    bool     long_distance_matching = false;
+    // log2 of the zstd window size, 0 lets zstd choose based on the compression level
+    int    window_log = 0;
+    size_t frame_size = asset_bundle_format::DEFAULT_FRAME_SIZE;
+
+    // zstd dictionary to compress with, trained from a set of existing bundles
+    path   dictionary;
+    size_t max_dictionary_size = 110 * 1024;
+
+    // codec for each type of section, indexed by section_type
+    asset_bundle_format::section_codec
+        codecs[(size_t)asset_bundle_format::section_type::NUM_TYPES] = {};
 };
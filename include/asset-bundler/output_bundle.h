@@ -1,18 +1,26 @@
 #pragma once
+#include "asset-bundler/cache.h"
 #include "asset-bundler/model.h"
 
 using std::byte;
 
+class section_writer;
+
 class output_bundle {
-    path                               output_path;
-    string_id                          next_string_id = 1;
-    std::map<string_id, std::string>   strings;
-    texture_id                         next_texture_id = 1;
-    std::map<texture_id, texture_info> textures;
-    std::vector<material_info>         materials;
+    path                                       output_path;
+    string_id                                  next_string_id = 1;
+    std::map<string_id, std::string>           strings;
+    // interned strings, so that repeated names are only stored once
+    std::unordered_map<std::string, string_id> string_ids;
+    texture_id                                 next_texture_id = 1;
+    std::map<texture_id, texture_info>         textures;
+    std::vector<material_info>                 materials;
 
     std::vector<vertex>     vertices;
     std::vector<index_type> indices;
+    // filled from indices and vertices when the bundle is written
+    std::vector<short_index_type> short_indices;
+    std::vector<quantized_vertex> quantized_vertices;
 
     std::vector<mesh_info>   meshes;
     std::vector<object_info> objects;
@@ -20,38 +28,91 @@ class output_bundle {
 
     std::vector<environment_info> environments;
 
-    std::pair<size_t, size_t> total_and_header_size() const;
-    void                      copy_strings(byte*& header_ptr, byte*& data_ptr, byte* top) const;
-    void                      copy_textures(byte*& header_ptr, byte*& data_ptr, byte* top) const;
-    void                      copy_materials(byte*& header_ptr) const;
-    void                      copy_meshes(byte*& header_ptr) const;
-    void                      copy_objects(byte*& header_ptr, byte*& data_ptr, byte* top) const;
-    void                      copy_groups(byte*& header_ptr, byte*& data_ptr, byte* top) const;
-    void copy_environments(byte*& header_ptr, byte*& data_ptr, byte* top) const;
+    struct name_table_data {
+        std::vector<uint32_t>                       seeds;
+        std::vector<asset_bundle_format::name_slot> slots;
+    };
+
+    // indexed by asset_bundle_format::name_table_kind
+    std::vector<name_table_data> name_tables;
+
+    size_t layout_cpu_section(asset_bundle_format::header& h) const;
+    void   write_strings(section_writer& out, const asset_bundle_format::header& h) const;
+    void   write_textures(section_writer& out, const asset_bundle_format::header& h) const;
+    void   write_environments(section_writer& out, const asset_bundle_format::header& h) const;
+    void   write_materials(section_writer& out, const asset_bundle_format::header& h) const;
+    void   write_meshes(section_writer& out, const asset_bundle_format::header& h) const;
+    void   write_objects(section_writer& out, const asset_bundle_format::header& h) const;
+    void   write_groups(section_writer& out, const asset_bundle_format::header& h) const;
+    void   write_name_tables(section_writer& out, const asset_bundle_format::header& h) const;
+
+    static name_table_data build_name_table(
+        const std::vector<asset_bundle_format::name_slot>& entries,
+        const std::map<string_id, std::string>&            strings
+    );
+    void build_name_tables();
+
+    // texture ids are reserved before textures are loaded, so textures that turn out to be
+    // duplicates or fail to load leave holes. the renderer indexes textures by id, so the ids are
+    // renumbered to 1..n without holes before the bundle is written
+    void compact_texture_ids();
+
+    void split_short_indices();
+    void quantize_vertices();
 
-    class texture_processor* tex_proc;
+    std::vector<asset_bundle_format::section_header> layout_gpu_sections() const;
+
+    void store_texture_in_cache(const texture_info& info, const void* data) const;
+    void store_environment_in_cache(const environment_info& info, const void* data) const;
+
+    class texture_processor*   tex_proc;
+    options                    opts;
+    std::optional<asset_cache> cache;
 
   public:
-    output_bundle(path output_path, class texture_processor* tp)
-        : output_path(std::move(output_path)), tex_proc(tp) {}
+    output_bundle(path output_path, class texture_processor* tp, options opts = {})
+        : output_path(std::move(output_path)), tex_proc(tp), opts(std::move(opts)) {
+        if(!this->opts.cache_dir.empty()) cache.emplace(this->opts.cache_dir);
+    }
 
     string_id add_string(const std::string& s) {
+        auto existing = string_ids.find(s);
+        if(existing != string_ids.end()) return existing->second;
         auto id = next_string_id++;
         strings.emplace(id, s);
+        string_ids.emplace(s, id);
         return id;
     }
 
     texture_id reserve_texture_id() { return next_texture_id++; }
 
     void add_texture(
+        texture_id                         id,
+        const std::string&                 name,
+        uint32_t                           width,
+        uint32_t                           height,
+        int                                nchannels,
+        stbi_uc*                           data,
+        texture_usage                      usage       = texture_usage::color,
+        std::optional<texture_cache_entry> cache_entry = {}
+    );
+
+    // add a texture whose mip levels were already processed, taking ownership of data
+    void add_processed_texture(
         texture_id         id,
         const std::string& name,
-        uint32_t           width,
-        uint32_t           height,
-        int                nchannels,
-        stbi_uc*           data
+        const image_info&  img,
+        stbi_uc*           data,
+        size_t             len,
+        texture_usage      usage
     );
 
+    // size of a texture that has been added, with all its mip levels
+    inline size_t texture_size(texture_id id) const { return textures.at(id).len; }
+
+    // make every material that refers to the texture `from` use the texture `to` instead
+    void remap_texture(texture_id from, texture_id to);
+
     // returns the current vertex offset
     size_t start_vertex_gather(size_t num_verts) {
         vertices.reserve(num_verts);
@@ -85,7 +146,17 @@ class output_bundle {
     void add_group(group_info&& info) { groups.emplace_back(info); }
 
     void add_environment(
-        const std::string& name, uint32_t width, uint32_t height, int nchannels, float* data
+        const std::string&            name,
+        uint32_t                      width,
+        uint32_t                      height,
+        int                           nchannels,
+        float*                        data,
+        std::optional<content_digest> cache_key = {}
+    );
+
+    // add an environment that was already processed, taking ownership of data
+    void add_processed_environment(
+        const std::string& name, const cached_environment_header& processed, stbi_uc* data
     );
 
     void write();
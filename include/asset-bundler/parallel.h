@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// a fixed set of threads that run jobs from a bounded queue. submitting waits while the queue is
+// full, so whoever makes the jobs can't get arbitrarily far ahead of the threads running them
+class worker_pool {
+    std::deque<std::function<void()>> queue;
+    size_t                            max_queued;
+    std::mutex                        mutex;
+    std::condition_variable           queue_not_empty, queue_not_full;
+    bool                              stopping = false;
+    std::vector<std::thread>          threads;
+
+    void push(std::function<void()> job);
+    void run();
+
+  public:
+    // num_threads of 0 starts one thread per hardware thread. max_queued of 0 allows one queued
+    // job per thread
+    explicit worker_pool(unsigned num_threads, size_t max_queued = 0);
+    worker_pool(const worker_pool&)            = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+    // finishes every job that is still queued before joining the threads
+    ~worker_pool();
+
+    unsigned size() const { return (unsigned)threads.size(); }
+
+    // queue fn to run on one of the threads, the future holds its result or exception
+    template<typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& fn) {
+        // std::function must be copyable, and packaged_task is not
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(
+            std::forward<F>(fn)
+        );
+        auto result = task->get_future();
+        push([task] { (*task)(); });
+        return result;
+    }
+};
+
+// run fn(i) for every i in [0, num_tasks) on the pool's threads and the calling one, returning
+// once all of them are done
+template<typename F>
+void parallel_for(size_t num_tasks, worker_pool& workers, const F& fn) {
+    std::atomic<size_t> next_task = 0;
+    auto                work      = [&] {
+        for(size_t i = next_task++; i < num_tasks; i = next_task++)
+            fn(i);
+    };
+    std::vector<std::future<void>> helpers;
+    for(size_t i = 1; i < std::min<size_t>(workers.size() + 1, num_tasks); ++i)
+        helpers.emplace_back(workers.submit(work));
+    // the helpers reference this frame, so they have to be done before anything is thrown
+    std::exception_ptr error;
+    try {
+        work();
+    } catch(...) {
+        error = std::current_exception();
+    }
+    for(auto& h : helpers)
+        h.wait();
+    if(error) std::rethrow_exception(error);
+    for(auto& h : helpers)
+        h.get();
+}
+
+// run fn(first, last) over runs of rows in [0, num_rows) on the pool's threads and the calling one
+template<typename F>
+void parallel_rows(uint32_t num_rows, worker_pool& workers, const F& fn) {
+    const uint32_t rows_per_task = 16;
+    uint32_t       num_tasks     = (num_rows + rows_per_task - 1) / rows_per_task;
+    parallel_for(num_tasks, workers, [&](size_t i) {
+        fn((uint32_t)i * rows_per_task, std::min(num_rows, ((uint32_t)i + 1) * rows_per_task));
+    });
+}
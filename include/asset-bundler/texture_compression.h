@@ -0,0 +1,24 @@
+#pragma once
+#include "asset-bundler/model.h"
+#include "asset-bundler/parallel.h"
+
+// choose the block-compressed format for a texture from what it is used for. base colors only
+// get an alpha channel if the (uncompressed, top level) data has some texel that is not opaque
+vk::Format block_compressed_format(
+    texture_usage usage, vk::Format format, uint32_t width, uint32_t height, const stbi_uc* data
+);
+
+// block compress a chain of mip levels that are tightly packed one after another, like the texture
+// processor produces them. usage decides how BC7 weighs errors in each channel. the block rows of
+// every level are spread over the workers
+void block_compress_mip_chain(
+    const uint8_t* src,
+    vk::Format     src_format,
+    uint32_t       width,
+    uint32_t       height,
+    uint32_t       mip_levels,
+    vk::Format     dest_format,
+    texture_usage  usage,
+    uint8_t*       dest,
+    worker_pool&   workers
+);
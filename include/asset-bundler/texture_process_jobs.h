@@ -21,24 +21,57 @@ struct process_job {
     void init_staging_buffer(const std::shared_ptr<gpu_allocator>& alloc, size_t size);
 };
 
-struct texture_process_job : public process_job {
+// one texture in a texture_batch, which shares the batch's command buffer and staging buffer
+struct texture_process_job {
+    // the texture being processed, which recieves the results when the batch finishes
+    texture_info*              info;
     vk::ImageCreateInfo        image_info;
     std::unique_ptr<gpu_image> img;
+    // format the texture is stored in, the results are block compressed if it differs from the
+    // format of image_info
+    vk::Format                 output_format;
+    // where the texture is in the staging buffer, first the top level and then the whole chain
+    size_t                     staging_offset, total_output_size;
 
+    // process the texture in the given (uncompressed) format, which may not be info->img.format,
+    // copying the top level into staging at staging_offset
     texture_process_job(
+        const std::shared_ptr<gpu_allocator>& alloc,
+        texture_info*                         info,
+        vk::Format                            format,
+        gpu_buffer&                           staging,
+        size_t                                staging_offset
+    );
+
+    // record the upload, mip level generation and readback of the texture
+    void build_cmd_buffer(vk::CommandBuffer cmd_buffer, vk::Buffer staging) const;
+
+  private:
+    void generate_mipmaps(vk::CommandBuffer cmd_buffer, vk::Buffer staging) const;
+};
+
+// many texture jobs recorded into one command buffer and submitted together, so that small
+// textures do not each cost a submission and a fence. batches are reused once they finish
+struct texture_batch {
+    vk::UniqueCommandBuffer          cmd_buffer;
+    vk::UniqueFence                  fence;
+    std::unique_ptr<gpu_buffer>      staging;
+    // bytes of staging buffer there are, and that the jobs take up so far
+    size_t                           capacity, size;
+    std::vector<texture_process_job> jobs;
+
+    texture_batch(
         vk::Device                            dev,
         vk::CommandPool                       cmd_pool,
         const std::shared_ptr<gpu_allocator>& alloc,
-        texture_info*                         info
+        size_t                                capacity
     );
-
-    void generate_mipmaps();
 };
 
 struct environment_process_job : public process_job {
     std::vector<vk::UniqueDescriptorSet> desc_sets;
-    std::unique_ptr<gpu_image>           src, skybox, diffuse_map;
-    vk::UniqueImageView                  src_view, skybox_view, diffuse_map_view;
+    std::unique_ptr<gpu_image>           src, skybox;
+    vk::UniqueImageView                  src_view, skybox_view;
 
     environment_process_job(
         vk::Device                                dev,
@@ -49,14 +82,12 @@ struct environment_process_job : public process_job {
         uint32_t                                  src_width,
         uint32_t                                  src_height,
         int                                       src_nchannels,
-        float*                                    src_data,
-        bool                                      enable_ibl_precomp
+        float*                                    src_data
     );
 
   private:
     vk::ImageCreateInfo src_image_info;
     vk::ImageCreateInfo sky_image_info;
-    vk::ImageCreateInfo diffuse_map_image_info;
 
     void build_cmd_buffer(
         vk::CommandBuffer cmd_buffer, struct environment_process_job_resources* res
@@ -64,3 +95,8 @@ struct environment_process_job : public process_job {
 };
 
 size_t linear_image_size_in_bytes(const vk::ImageCreateInfo& image_info);
+
+// a mapped buffer for moving data to and from the GPU
+std::unique_ptr<gpu_buffer> create_staging_buffer(
+    const std::shared_ptr<gpu_allocator>& alloc, size_t size
+);
@@ -1,13 +1,15 @@
 #pragma once
 #include "asset-bundler/model.h"
+#include "asset-bundler/parallel.h"
 #include "egg/renderer/memory.h"
+#include <deque>
 #include <vulkan/vulkan.hpp>
 
 struct environment_process_job_resources {
     vk::UniquePipelineLayout      pipeline_layout;
     vk::UniqueDescriptorSetLayout desc_set_layout;
     vk::UniqueDescriptorPool      desc_pool;
-    vk::UniquePipeline            skybox_pipeline, diffuse_map_pipeline;
+    vk::UniquePipeline            skybox_pipeline;
     vk::UniqueSampler             sampler;
 
     environment_process_job_resources(vk::Device dev);
@@ -25,22 +27,53 @@ class texture_processor {
 
     std::shared_ptr<gpu_allocator> allocator;
 
-    std::unordered_map<texture_id, struct texture_process_job>    jobs;
-    std::unordered_map<string_id, struct environment_process_job> env_jobs;
+    // textures are recorded into the open batch until it is full and then submitted. submitted
+    // batches finish in order, after which they are kept to be reused by later batches
+    std::unique_ptr<struct texture_batch>              open_batch;
+    std::deque<std::unique_ptr<struct texture_batch>>  submitted_batches;
+    std::vector<std::unique_ptr<struct texture_batch>> free_batches;
+    // staging memory taken by textures in the open and submitted batches, about the same as the
+    // device memory their images take
+    size_t                                             bytes_in_flight = 0;
+
+    // keyed by environment index, since environments from different directories can share a name
+    std::unordered_map<size_t, struct environment_process_job> env_jobs;
 
     std::unique_ptr<environment_process_job_resources> env_res;
 
     options opts;
+    // threads used for CPU processing
+    worker_pool workers;
+
+    // set up Vulkan, returning false if there is no GPU that can process textures
+    bool init_device();
+
+    // whether mip levels are generated on the GPU, which needs a device and a box filter
+    bool gpu_mips() const;
+
+    void submit_open_batch();
+    // wait for the oldest submitted batch and move its results into each of its textures
+    void finish_oldest_batch();
 
   public:
     texture_processor(options opts);
     ~texture_processor();
 
+    // process a texture, leaving the result in info->data either right away or once
+    // finish_textures is called. info must stay where it is until then
     void submit_texture(texture_id id, texture_info* info);
-    void recieve_processed_texture(texture_id id, void* destination);
+    // wait for every texture that is still on the GPU
+    void finish_textures();
 
+    // process the environment that will have the given index in the bundle. if the result is not
+    // in the returned info's data, it is fetched with recieve_processed_environment
     environment_info submit_environment(
-        string_id name, uint32_t width, uint32_t height, int nchannels, float* data
+        size_t    index,
+        string_id name,
+        uint32_t  width,
+        uint32_t  height,
+        int       nchannels,
+        float*    data
     );
-    void recieve_processed_environment(string_id name, void* destination);
+    void recieve_processed_environment(size_t index, void* destination);
 };
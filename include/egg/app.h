@@ -17,6 +17,7 @@ class app {
     std::unique_ptr<input_distributor> inpd;
 
     virtual std::unique_ptr<rendering_algorithm> create_rendering_algorithm() = 0;
+    // called on a background thread while the renderer is being created
     virtual std::shared_ptr<asset_bundle>        load_assets()                = 0;
     virtual void                                 create_scene()               = 0;
 
@@ -1,9 +1,88 @@
 #pragma once
 #include "asset-bundler/format.h"
 #include "glm.h"
+#include <cstdlib>
 #include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
 #include <optional>
 
+// a read-only memory mapping of an entire file
+class mapped_file {
+    const uint8_t* ptr = nullptr;
+    size_t         len = 0;
+#ifdef _WIN32
+    void* file_handle    = nullptr;
+    void* mapping_handle = nullptr;
+#else
+    // kept open so that ranges can also be read without faulting in the mapping
+    int fd = -1;
+#endif
+
+  public:
+    mapped_file(const std::filesystem::path& location);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&)            = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    inline const uint8_t* data() const { return ptr; }
+
+    inline size_t size() const { return len; }
+
+    // copy a range of the file into dest, blocking until it has been read
+    void read(size_t offset, size_t size, uint8_t* dest) const;
+
+    // hint that a range of the file will be read soon, so the OS can start reading it in the
+    // background
+    void read_ahead(size_t offset, size_t size) const;
+
+    // read a range of the file into memory now, so that later accesses don't wait on I/O
+    void prefetch(size_t offset, size_t size) const;
+};
+
+struct ZSTD_DDict_s;
+
+// a zstd dictionary shared by a set of bundles
+// it is digested once on load and can then be used by any number of bundles and threads at once
+class bundle_dictionary {
+    ZSTD_DDict_s* ddict;
+    uint32_t      id;
+
+  public:
+    bundle_dictionary(const std::filesystem::path& location);
+    ~bundle_dictionary();
+
+    bundle_dictionary(const bundle_dictionary&)            = delete;
+    bundle_dictionary& operator=(const bundle_dictionary&) = delete;
+
+    inline uint32_t dictionary_id() const { return id; }
+
+    inline const ZSTD_DDict_s* digested() const { return ddict; }
+};
+
+struct bundle_load_progress {
+    enum class stage { metadata, prefetch, gpu_data } current_stage;
+    // bytes processed so far in the current stage, out of total
+    size_t done, total;
+};
+
+struct bundle_load_options {
+    // number of threads used to decompress bundle frames, or 0 to use one per hardware thread
+    size_t decompression_threads = 0;
+
+    // read all of the compressed GPU data into memory as soon as the bundle is opened
+    bool prefetch_gpu_data = false;
+
+    // required to open bundles that were compressed with a dictionary
+    std::shared_ptr<const bundle_dictionary> dictionary;
+
+    // called as a bundle loads, possibly from a background or worker thread, but never
+    // concurrently with itself
+    std::function<void(const bundle_load_progress&)> progress;
+};
+
 class asset_bundle {
     // std::unordered_map<string_id, std::string> strings;
     // std::unordered_map<texture_id, asset_bundle_format::texture_header> textures;
@@ -11,9 +90,21 @@ class asset_bundle {
     // std::vector<asset_bundle_format::material_header> materials;
     // std::vector<asset_bundle_format::object_header> objects;
     // std::vector<asset_bundle_format::group_header> groups;
-    uint8_t* bundle_data    = nullptr;
-    size_t   total_size     = 0;
-    bool     gpu_data_taken = false;
+    mapped_file                                file;
+    const asset_bundle_format::section_header* sections;
+    size_t                                     section_count;
+    const asset_bundle_format::frame_header*   frames;
+    size_t                                     frame_count, frame_size;
+    bundle_load_options                        options;
+    // the dictionary the frames were compressed with, if any
+    const bundle_dictionary* dictionary = nullptr;
+
+    struct free_deleter {
+        void operator()(uint8_t* p) const { free(p); }
+    };
+
+    // the decompressed CPU section
+    std::unique_ptr<uint8_t[], free_deleter> cpu_data;
 
     asset_bundle_format::header*             header;
     asset_bundle_format::string_header*      strings;
@@ -21,19 +112,80 @@ class asset_bundle {
     asset_bundle_format::environment_header* environments;
     asset_bundle_format::mesh_header*        meshes;
     asset_bundle_format::material_header*    materials;
-    asset_bundle_format::object_header*      objects;
-    asset_bundle_format::group_header*       groups;
+
+    // objects and groups are stored as parallel arrays, one per property
+    struct {
+        string_id*                             names;
+        asset_bundle_format::affine_transform* transforms;
+        aabb*                                  bounds;
+        asset_bundle_format::index_range*      meshes;
+    } objects;
+
+    struct {
+        string_id*                        names;
+        aabb*                             bounds;
+        asset_bundle_format::index_range* objects;
+    } groups;
+
+    uint32_t*  object_mesh_indices;
+    object_id* group_object_indices;
+
+    // decompress the frames of sections [first, last) in parallel, placing each section at
+    // dest + (gpu_offset - base_offset)
+    void decompress_sections(
+        size_t first, size_t last, uint8_t* dest, size_t dest_size, size_t base_offset
+    ) const;
+
+    // locate a table of count items in the CPU section, checking that it is in bounds
+    template<typename T>
+    T* cpu_table(uint32_t offset, size_t count) const;
+
+    // locate a table of indices that the ranges point into, checking that it is in bounds and that
+    // every index in it is less than bound
+    template<typename T>
+    T* index_table(
+        uint32_t                                offset,
+        const asset_bundle_format::index_range* ranges,
+        size_t                                  num_ranges,
+        size_t                                  bound
+    ) const;
+
+    // check that every string and name table is inside the CPU section, and that name table slots
+    // refer to strings and items that exist
+    void check_names() const;
+
+    // returns the index stored for name in one of the bundle's name tables
+    std::optional<uint32_t> find_name(
+        asset_bundle_format::name_table_kind kind, std::string_view name
+    ) const;
 
   public:
-    asset_bundle(const std::filesystem::path& location);
-    ~asset_bundle();
+    asset_bundle(const std::filesystem::path& location, const bundle_load_options& options = {});
+
+    asset_bundle(const asset_bundle&)            = delete;
+    asset_bundle& operator=(const asset_bundle&) = delete;
 
     inline const asset_bundle_format::header& bundle_header() const { return *header; }
 
-    // dest must be big enough to store all GPU data
-    void take_gpu_data(uint8_t* dest);
+    inline size_t num_sections() const { return section_count; }
+
+    inline const asset_bundle_format::section_header& section(size_t i) const {
+        return sections[i];
+    }
+
+    // decompress a single section directly into dest, which must be at least the section's
+    // uncompressed size
+    void decompress_section(size_t i, uint8_t* dest, size_t dest_size) const;
+
+    // decompress all GPU sections directly into dest (for instance a mapped staging buffer) without
+    // any intermediate copies, spreading the frames over the decompression threads. dest_size must
+    // be at least gpu_data_size()
+    void decompress_gpu_data(uint8_t* dest, size_t dest_size) const;
 
-    inline size_t gpu_data_size() const { return total_size - bundle_header().gpu_data_offset; }
+    inline size_t gpu_data_size() const { return header->gpu_data_size; }
+
+    // read the compressed GPU data into memory so that decompress_gpu_data() doesn't wait on I/O
+    void prefetch_gpu_data() const;
 
     inline size_t num_strings() const { return header->num_strings; }
 
@@ -43,6 +195,7 @@ class asset_bundle {
 
     const asset_bundle_format::texture_header& texture(texture_id id) const;
     const asset_bundle_format::texture_header& texture_by_index(size_t i) const;
+    std::optional<texture_id>                  texture_by_name(std::string_view name) const;
 
     inline size_t num_environments() const { return header->num_environments; }
 
@@ -50,14 +203,16 @@ class asset_bundle {
 
     inline size_t num_objects() const { return header->num_objects; }
 
-    const glm::mat4&           object_transform(object_id id) const;
+    glm::mat4                  object_transform(object_id id) const;
     class object_mesh_iterator object_meshes(object_id id) const;
     string_id                  object_name(object_id id) const;
     const aabb&                object_bounds(object_id id) const;
+    std::optional<object_id>   object_by_name(std::string_view name) const;
 
     inline size_t num_materials() const { return header->num_materials; }
 
     const asset_bundle_format::material_header& material(size_t index) const;
+    std::optional<size_t>                       material_by_name(std::string_view name) const;
 
     inline size_t num_groups() const { return header->num_groups; }
 
@@ -67,6 +222,11 @@ class asset_bundle {
     std::optional<size_t>       group_by_name(std::string_view name) const;
 };
 
+// open a bundle on a background thread, so that its I/O and decompression overlap with other work
+std::future<std::shared_ptr<asset_bundle>> load_bundle_async(
+    std::filesystem::path location, bundle_load_options options = {}
+);
+
 class object_mesh_iterator {
     asset_bundle_format::mesh_header* meshes;
     uint32_t*                         indices;
@@ -43,7 +43,7 @@ class forward_rendering_algorithm : public rendering_algorithm {
         vk::PushConstantRange   per_object_push_constants_range
     ) override;
 
-    void create_pipelines() override;
+    void create_pipelines(asset_bundle_format::vertex_format vertices) override;
 
     void create_framebuffers(abstract_frame_renderer* fr) override;
 
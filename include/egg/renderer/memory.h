@@ -90,6 +90,10 @@ class gpu_image {
     void* cpu_mapped() const;
 };
 
+// size of one tightly packed level of a 2D image, which for block-compressed formats counts whole
+// blocks
+size_t image_level_size_in_bytes(uint32_t width, uint32_t height, vk::Format format);
+
 std::vector<vk::BufferImageCopy> copy_regions_for_linear_image2d(
     uint32_t   width,
     uint32_t   height,
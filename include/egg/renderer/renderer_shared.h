@@ -1,4 +1,5 @@
 #pragma once
+#include "asset-bundler/format.h"
 #include "egg/renderer/memory.h"
 #include <filesystem>
 #include <functional>
@@ -61,8 +62,8 @@ class rendering_algorithm {
         vk::DescriptorSetLayout scene_data_desc_set_layout,
         vk::PushConstantRange   per_object_push_constants_range
     ) = 0;
-    // load shaders and create pipelines
-    virtual void create_pipelines() = 0;
+    // load shaders and create pipelines for geometry with the given vertex layout
+    virtual void create_pipelines(asset_bundle_format::vertex_format vertices) = 0;
     // create framebuffers
     virtual void create_framebuffers(abstract_frame_renderer* fr) = 0;
     // generate command buffers
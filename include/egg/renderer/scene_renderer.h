@@ -4,6 +4,7 @@
 #include "egg/renderer/memory.h"
 #include "egg/renderer/renderer.h"
 #include "glm.h"
+#include <array>
 
 /*
  * transforms (can change once per frame)
@@ -26,16 +27,27 @@ struct texture {
 };
 
 struct environment {
-    texture sky, diffuse_irradiance;
+    texture             sky;
+    std::array<vec3, 9> diffuse_irradiance_sh;
 };
 
+// texture index pushed for a texture the material doesn't have, which the shaders check for
+const texture_id NO_TEXTURE_INDEX = 0xffff;
+
 struct per_object_push_constants {
     uint32_t   transform_index;
-    texture_id base_color, normals, roughness, metallic;
+    // orm is the packed occlusion/roughness/metallic texture
+    // these index the scene's textures, or are NO_TEXTURE_INDEX
+    texture_id base_color, normals, orm;
+    // mesh bounds, which quantized vertex positions are relative to
+    float      position_min[3], position_extent[3];
 };
 
 struct shader_uniform_values {
-    vec3 camera_pos;
+    vec3  camera_pos;
+    float padding;
+    // the current environment's diffuse irradiance, with w unused to match the std140 layout
+    vec4  env_irradiance_sh[9];
 };
 
 struct gpu_static_scene_data {
@@ -43,13 +55,14 @@ struct gpu_static_scene_data {
         renderer* r, std::shared_ptr<asset_bundle> bundle, vk::CommandBuffer upload_cmds
     );
 
-    std::unique_ptr<gpu_buffer> vertex_buffer, index_buffer, staging_buffer;
+    std::unique_ptr<gpu_buffer> vertex_buffer, index_buffer, short_index_buffer, staging_buffer;
     std::unique_ptr<gpu_buffer> cube_vertex_buffer, cube_index_buffer;
     // TODO: these texture maps are dubious, maybe we should make the linear ordering of texture ids
     // explicit so things are faster
     std::unordered_map<texture_id, texture>    textures;
-    std::unordered_map<string_id, environment> envs;
-    string_id                                  current_env;
+    // indexed like the bundle's environments, since their names need not be unique
+    std::vector<environment>                   envs;
+    size_t                                     current_env = 0;
 
     vk::UniqueSampler             texture_sampler;
     vk::UniqueDescriptorSetLayout desc_set_layout;
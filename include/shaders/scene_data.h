@@ -1,9 +1,16 @@
 #extension GL_EXT_shader_16bit_storage : enable
 #extension GL_EXT_nonuniform_qualifier : enable
 
+// texture index of a texture the material doesn't have, the same as NO_TEXTURE_INDEX
+const uint NO_TEXTURE = 65535u;
+
 struct per_object_push_constants {
     uint     transform_index;
-    uint16_t base_color, normals, roughness, metallic;
+    // orm is the packed occlusion/roughness/metallic texture
+    // these index textures, or are NO_TEXTURE
+    uint16_t base_color, normals, orm;
+    // mesh bounds, which quantized vertex positions are relative to
+    float    position_min[3], position_extent[3];
 };
 
 layout(push_constant) uniform per_object_pc {
@@ -11,7 +18,11 @@ layout(push_constant) uniform per_object_pc {
     per_object_push_constants object;
 };
 
-layout(set = 0, binding = 2) uniform per_frame { vec3 camera_position; };
+layout(set = 0, binding = 2) uniform per_frame {
+    vec3 camera_position;
+    // diffuse irradiance of the current environment, evaluated with sh_irradiance
+    vec4 env_irradiance_sh[9];
+};
 
 // TODO: should the set index be configurable?
 layout(set = 0, binding = 0) buffer transforms_buffer { mat4 transforms[]; };
@@ -0,0 +1,17 @@
+
+// diffuse irradiance stored as 9 spherical harmonic coefficients (see environment_header), already
+// convolved with the cosine lobe and divided by pi. sh[i].w is unused, which keeps the std140
+// array stride
+vec3 sh_irradiance(in vec4 sh[9], vec3 n) {
+    vec3 e = sh[0].xyz * 0.282095
+           + sh[1].xyz * (0.488603 * n.y)
+           + sh[2].xyz * (0.488603 * n.z)
+           + sh[3].xyz * (0.488603 * n.x)
+           + sh[4].xyz * (1.092548 * n.x * n.y)
+           + sh[5].xyz * (1.092548 * n.y * n.z)
+           + sh[6].xyz * (0.315392 * (3.0 * n.z * n.z - 1.0))
+           + sh[7].xyz * (1.092548 * n.x * n.z)
+           + sh[8].xyz * (0.546274 * (n.x * n.x - n.y * n.y));
+    // the projection rings a little below zero around bright lights
+    return max(e, vec3(0.0));
+}
@@ -1,5 +1,15 @@
-
 layout(location = 0) in vec3 positionM;
 layout(location = 1) in vec3 normalM;
 layout(location = 2) in vec3 tangentM;
 layout(location = 3) in vec2 tex_coord;
+
+// set when the vertices are asset_bundle_format::vertex_format::quantized, in which case the
+// position is a unorm within the mesh bounds and the normal and tangent are octahedral encoded in xy
+layout(constant_id = 0) const bool quantized_vertices = false;
+
+vec3 decode_octahedral(vec2 e) {
+    vec3  v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+    return normalize(v);
+}
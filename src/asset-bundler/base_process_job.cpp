@@ -10,8 +10,10 @@ process_job::process_job(vk::Device dev, vk::CommandPool cmd_pool)
     fence = device.createFenceUnique(vk::FenceCreateInfo{});
 }
 
-void process_job::init_staging_buffer(const std::shared_ptr<gpu_allocator>& alloc, size_t size) {
-    staging = std::make_unique<gpu_buffer>(
+std::unique_ptr<gpu_buffer> create_staging_buffer(
+    const std::shared_ptr<gpu_allocator>& alloc, size_t size
+) {
+    return std::make_unique<gpu_buffer>(
         alloc,
         vk::BufferCreateInfo{
             {}, size, vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst
@@ -24,6 +26,10 @@ void process_job::init_staging_buffer(const std::shared_ptr<gpu_allocator>& allo
     );
 }
 
+void process_job::init_staging_buffer(const std::shared_ptr<gpu_allocator>& alloc, size_t size) {
+    staging = create_staging_buffer(alloc, size);
+}
+
 void process_job::submit(vk::Queue queue) {
     cmd_buffer->end();
     queue.submit(vk::SubmitInfo{0, nullptr, nullptr, 1, &cmd_buffer.get()}, fence.get());
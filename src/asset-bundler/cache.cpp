@@ -0,0 +1,106 @@
+#include "asset-bundler/cache.h"
+#include "fs-shim.h"
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#ifdef _WIN32
+#    include <process.h>
+#else
+#    include <unistd.h>
+#endif
+
+// bump this whenever the layout of a cache entry or the processing of an asset changes in a way
+// that the options do not capture
+const uint32_t CACHE_VERSION = 6;
+
+bool content_hasher::add_file(const path& file_path) {
+    std::ifstream file{file_path, std::ios::binary};
+    if(!file) return false;
+    char buffer[64 * 1024];
+    while(file) {
+        file.read(buffer, sizeof(buffer));
+        add(buffer, (size_t)file.gcount());
+    }
+    return file.eof();
+}
+
+content_hasher asset_cache::start_key(const options& opts) const {
+    content_hasher key;
+    key.add_value(CACHE_VERSION);
+    key.add_value(asset_bundle_format::VERSION);
+    key.add_value(opts.compress_textures);
+    key.add_value(opts.cpu_mips);
+    key.add_value(opts.mips_filter);
+    key.add_value(opts.cpu_environments);
+    return key;
+}
+
+path asset_cache::entry_path(const content_digest& key) const {
+    std::ostringstream name;
+    name << std::hex << std::setfill('0');
+    for(auto b : key)
+        name << std::setw(2) << (unsigned)b;
+    auto s = name.str();
+    // spread entries over subdirectories so that no one directory gets too large
+    return dir / s.substr(0, 2) / s;
+}
+
+std::optional<std::vector<byte>> asset_cache::load_bytes(const content_digest& key) const {
+    std::ifstream file{entry_path(key), std::ios::binary | std::ios::ate};
+    if(!file) return {};
+    std::vector<byte> data((size_t)file.tellg());
+    file.seekg(0);
+    if(!file.read((char*)data.data(), (std::streamsize)data.size())) return {};
+    content_digest stored;
+    if(data.size() < sizeof(stored)) return {};
+    memcpy(stored.data(), data.data(), sizeof(stored));
+    if(sha256_of(data.data() + sizeof(stored), data.size() - sizeof(stored)) != stored) return {};
+    data.erase(data.begin(), data.begin() + sizeof(stored));
+    return data;
+}
+
+static unsigned long process_id() {
+#ifdef _WIN32
+    return (unsigned long)_getpid();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+void asset_cache::store(
+    const content_digest& key, const void* header, size_t header_len, const void* data, size_t len
+) const {
+    auto            p = entry_path(key);
+    std::error_code ec;
+    std::filesystem::create_directories(p.parent_path(), ec);
+    sha256 digest;
+    digest.add(header, header_len);
+    digest.add(data, len);
+    auto entry_digest = digest.digest();
+    // entries are written to a temporary file and then renamed, so that a bundler that is stopped
+    // part way through never leaves a truncated entry behind. bundlers sharing a cache can write
+    // the same entry at once, so each writes its own temporary file
+    std::random_device random;
+    std::ostringstream tmp_name;
+    tmp_name << path_to_string(p.filename()) << "." << process_id() << "." << std::hex << random()
+             << random() << ".tmp";
+    auto tmp = p.parent_path() / tmp_name.str();
+    {
+        std::ofstream file{tmp, std::ios::binary | std::ios::trunc};
+        file.write((const char*)entry_digest.data(), (std::streamsize)entry_digest.size());
+        file.write((const char*)header, (std::streamsize)header_len);
+        file.write((const char*)data, (std::streamsize)len);
+        if(!file) {
+            std::cout << "warning: failed to write cache entry " << p << "\n";
+            file.close();
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmp, p, ec);
+    if(ec) {
+        std::cout << "warning: failed to write cache entry " << p << ": " << ec.message() << "\n";
+        std::filesystem::remove(tmp, ec);
+    }
+}
@@ -0,0 +1,109 @@
+#include "asset-bundler/dictionary.h"
+#include "asset-bundler/format.h"
+#include "fs-shim.h"
+#include <algorithm>
+#include <fstream>
+#include <zdict.h>
+#include <zstd.h>
+
+using asset_bundle_format::file_header;
+using asset_bundle_format::frame_header;
+using asset_bundle_format::section_header;
+
+// larger samples add little to the dictionary but slow training down a lot
+const size_t MAX_SAMPLE_SIZE = 128 * 1024;
+
+std::vector<byte> read_file(const path& file_path) {
+    std::ifstream file{file_path, std::ios::binary | std::ios::ate};
+    if(!file) throw std::runtime_error("could not open " + path_to_string(file_path));
+    std::vector<byte> data((size_t)file.tellg());
+    file.seekg(0);
+    if(!file.read((char*)data.data(), (std::streamsize)data.size()))
+        throw std::runtime_error("could not read " + path_to_string(file_path));
+    return data;
+}
+
+// append the start of every zstd frame in a bundle to the training samples
+void add_bundle_samples(
+    const path& bundle_path, std::vector<byte>& samples, std::vector<size_t>& sample_sizes
+) {
+    auto        file = read_file(bundle_path);
+    const auto* fh   = (const file_header*)file.data();
+    if(file.size() < sizeof(file_header) || fh->magic != asset_bundle_format::MAGIC
+       || fh->version != asset_bundle_format::VERSION
+       || file.size() < sizeof(file_header) + sizeof(section_header) * fh->num_sections
+                            + sizeof(frame_header) * fh->num_frames)
+        throw std::runtime_error("invalid bundle file at: " + path_to_string(bundle_path));
+    if(fh->dictionary_id != 0)
+        throw std::runtime_error(
+            "can't train from " + path_to_string(bundle_path)
+            + ", it was already compressed with a dictionary"
+        );
+    const auto* sections = (const section_header*)(file.data() + sizeof(file_header));
+    const auto* frames   = (const frame_header*)(sections + fh->num_sections);
+
+    std::vector<byte> frame(fh->frame_size);
+    for(size_t i = 0; i < fh->num_sections; ++i) {
+        // the dictionary is only used by zstd frames
+        if(sections[i].codec != asset_bundle_format::section_codec::zstd) continue;
+        for(size_t j = 0; j < sections[i].num_frames; ++j) {
+            if(sections[i].first_frame + j >= fh->num_frames)
+                throw std::runtime_error("invalid bundle file at: " + path_to_string(bundle_path));
+            const auto& fr = frames[sections[i].first_frame + j];
+            if(fr.file_offset + fr.compressed_size > file.size())
+                throw std::runtime_error("bundle is truncated: " + path_to_string(bundle_path));
+            size_t size = ZSTD_decompress(
+                frame.data(), frame.size(), file.data() + fr.file_offset, fr.compressed_size
+            );
+            if(ZSTD_isError(size))
+                throw std::runtime_error(
+                    "failed to decompress " + path_to_string(bundle_path) + ": "
+                    + ZSTD_getErrorName(size)
+                );
+            size = std::min(size, MAX_SAMPLE_SIZE);
+            samples.insert(samples.end(), frame.begin(), frame.begin() + size);
+            sample_sizes.emplace_back(size);
+        }
+    }
+}
+
+void train_dictionary(
+    const path& output_path, const std::vector<path>& bundle_paths, const options& opts
+) {
+    std::vector<byte>   samples;
+    std::vector<size_t> sample_sizes;
+    for(const auto& p : bundle_paths) {
+        std::cout << "sampling " << p << "\n";
+        add_bundle_samples(p, samples, sample_sizes);
+    }
+    std::cout << "training dictionary on " << sample_sizes.size() << " samples ("
+              << samples.size() << " bytes)...\n";
+
+    std::vector<byte> dictionary(opts.max_dictionary_size);
+    size_t            size = ZDICT_trainFromBuffer(
+        dictionary.data(),
+        dictionary.size(),
+        samples.data(),
+        sample_sizes.data(),
+        (unsigned)sample_sizes.size()
+    );
+    if(ZDICT_isError(size))
+        throw std::runtime_error(
+            std::string("failed to train dictionary: ") + ZDICT_getErrorName(size)
+        );
+
+    std::ofstream out{output_path, std::ios::binary};
+    if(!out.write((const char*)dictionary.data(), (std::streamsize)size))
+        throw std::runtime_error("could not write dictionary to " + path_to_string(output_path));
+    std::cout << "wrote " << size << " byte dictionary "
+              << ZDICT_getDictID(dictionary.data(), size) << " to " << output_path << "\n";
+}
+
+std::pair<std::vector<byte>, uint32_t> load_dictionary(const path& dictionary_path) {
+    auto     dictionary = read_file(dictionary_path);
+    uint32_t id         = ZDICT_getDictID(dictionary.data(), dictionary.size());
+    // bundles record the id so that a loader can check it has the right dictionary
+    if(id == 0)
+        throw std::runtime_error("not a zstd dictionary: " + path_to_string(dictionary_path));
+    return {std::move(dictionary), id};
+}
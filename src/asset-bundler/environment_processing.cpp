@@ -0,0 +1,138 @@
+#include "asset-bundler/environment_processing.h"
+#include "asset-bundler/parallel.h"
+#include "egg/renderer/memory.h"
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+#include <mutex>
+#ifdef __SSE2__
+#    include <emmintrin.h>
+#endif
+
+const float PI = glm::pi<float>();
+
+// direction through texel (x, y) of a cubemap face, the same as shader_common.h
+vec3 cube_texel_direction(uint32_t face, uint32_t x, uint32_t y, uint32_t size) {
+    vec2 s = vec2(x, y) / (float)size * 2.f - 1.f;
+    vec3 d;
+    switch(face) {
+        case 0: d = vec3(+1.f, -s.y, -s.x); break;
+        case 1: d = vec3(-1.f, -s.y, +s.x); break;
+        case 2: d = vec3(+s.x, +1.f, +s.y); break;
+        case 3: d = vec3(+s.x, -1.f, -s.y); break;
+        case 4: d = vec3(+s.x, -s.y, +1.f); break;
+        default: d = vec3(-s.x, -s.y, -1.f); break;
+    }
+    return glm::normalize(d);
+}
+
+// sample an equirectangular map in direction d like the skybox shader does, bilinearly filtered
+// and wrapping around at the edges
+vec4 sample_equirect(const equirect_map& m, vec3 d) {
+    float fx = (std::atan2(d.z, d.x) / (2.f * PI) + 0.5f) * (float)m.width - 0.5f;
+    float fy = (std::asin(glm::clamp(d.y, -1.f, 1.f)) / PI + 0.5f) * (float)m.height - 0.5f;
+    float x0 = std::floor(fx), y0 = std::floor(fy);
+    float tx = fx - x0, ty = fy - y0;
+    auto  wrap = [](float i, uint32_t size) {
+        int64_t r = (int64_t)i % (int64_t)size;
+        return (size_t)(r < 0 ? r + size : r);
+    };
+    size_t xs[2] = {wrap(x0, m.width), wrap(x0 + 1.f, m.width)};
+    size_t ys[2] = {wrap(y0, m.height), wrap(y0 + 1.f, m.height)};
+    float  w[4]  = {(1.f - tx) * (1.f - ty), tx * (1.f - ty), (1.f - tx) * ty, tx * ty};
+#ifdef __SSE2__
+    if(m.nchannels == 4) {
+        // each texel is one vector of four channels
+        __m128 sum = _mm_setzero_ps();
+        for(size_t i = 0; i < 4; ++i) {
+            const float* t = m.data + (ys[i / 2] * m.width + xs[i % 2]) * 4;
+            sum            = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(t), _mm_set1_ps(w[i])));
+        }
+        vec4 result;
+        _mm_storeu_ps(&result.x, sum);
+        return result;
+    }
+#endif
+    vec4 result{0.f, 0.f, 0.f, 1.f};
+    for(int c = 0; c < std::min(m.nchannels, 4); ++c) {
+        result[c] = 0.f;
+        for(size_t i = 0; i < 4; ++i)
+            result[c] += w[i] * m.data[(ys[i / 2] * m.width + xs[i % 2]) * m.nchannels + c];
+    }
+    return result;
+}
+
+// the real spherical harmonic basis functions up to l = 2 in direction d
+std::array<float, 9> sh_basis(vec3 d) {
+    return {
+        0.282095f,
+        0.488603f * d.y,
+        0.488603f * d.z,
+        0.488603f * d.x,
+        1.092548f * d.x * d.y,
+        1.092548f * d.y * d.z,
+        0.315392f * (3.f * d.z * d.z - 1.f),
+        1.092548f * d.x * d.z,
+        0.546274f * (d.x * d.x - d.y * d.y)
+    };
+}
+
+std::array<vec3, 9> project_environment_sh(const equirect_map& src, worker_pool& workers) {
+    std::array<vec3, 9> total{};
+    std::mutex          total_lock;
+    parallel_rows(src.height, workers, [&](uint32_t first, uint32_t last) {
+        std::array<vec3, 9> sum{};
+        for(uint32_t y = first; y < last; ++y) {
+            // invert the mapping in sample_equirect to find the direction through each texel
+            float lat = ((float)y + 0.5f) / (float)src.height * PI - 0.5f * PI;
+            // texels near the poles cover less of the sphere
+            float solid_angle
+                = (2.f * PI / (float)src.width) * (PI / (float)src.height) * std::cos(lat);
+            for(uint32_t x = 0; x < src.width; ++x) {
+                float a = ((float)x + 0.5f) / (float)src.width * 2.f * PI - PI;
+                vec3  d{std::cos(lat) * std::cos(a), std::sin(lat), std::cos(lat) * std::sin(a)};
+                const float* t = src.data + ((size_t)y * src.width + x) * src.nchannels;
+                vec3         radiance{t[0]};
+                for(int c = 1; c < std::min(src.nchannels, 3); ++c)
+                    radiance[c] = t[c];
+                auto basis = sh_basis(d);
+                for(size_t i = 0; i < 9; ++i)
+                    sum[i] += radiance * (basis[i] * solid_angle);
+            }
+        }
+        std::lock_guard<std::mutex> lock{total_lock};
+        for(size_t i = 0; i < 9; ++i)
+            total[i] += sum[i];
+    });
+    return total;
+}
+
+void process_environment_on_cpu(
+    const environment_info& info, const equirect_map& src, uint8_t* dest, worker_pool& workers
+) {
+    // skybox, one task per run of rows of all the faces
+    uint32_t sky_size = info.skybox.width;
+    size_t   sky_face = image_level_size_in_bytes(sky_size, sky_size, info.skybox.format);
+    parallel_rows(sky_size * 6, workers, [&](uint32_t first, uint32_t last) {
+        for(uint32_t row = first; row < last; ++row) {
+            uint32_t face = row / sky_size, y = row % sky_size;
+            uint8_t* out  = dest + face * sky_face + (size_t)y * sky_size * 4;
+            for(uint32_t x = 0; x < sky_size; ++x) {
+                vec4 c = sample_equirect(src, cube_texel_direction(face, x, y, sky_size));
+                c      = glm::clamp(c, 0.f, 1.f);
+                for(size_t i = 0; i < 4; ++i)
+                    out[x * 4 + i] = (uint8_t)(c[i] * 255.f + 0.5f);
+            }
+        }
+    });
+}
+
+std::array<vec3, 9> diffuse_irradiance_sh(const equirect_map& src, worker_pool& workers) {
+    // convolving with the cosine lobe scales the bands by pi, 2pi/3 and pi/4. dividing that by pi
+    // turns irradiance into the radiance a white diffuse surface reflects
+    auto           sh        = project_environment_sh(src, workers);
+    const float    band[]    = {1.f, 2.f / 3.f, 1.f / 4.f};
+    const uint32_t sh_band[] = {0, 1, 1, 1, 2, 2, 2, 2, 2};
+    for(size_t i = 0; i < 9; ++i)
+        sh[i] *= band[sh_band[i]];
+    return sh;
+}
@@ -29,8 +29,7 @@ environment_process_job::environment_process_job(
     uint32_t                              src_width,
     uint32_t                              src_height,
     int                                   src_nchannels,
-    float*                                src_data,
-    bool                                  enable_ibl_precomp
+    float*                                src_data
 )
     : process_job(dev, cmd_pool) {
     // create image descriptions
@@ -52,17 +51,9 @@ environment_process_job::environment_process_job(
         vk::ImageCreateFlagBits::eCubeCompatible
     );
 
-    diffuse_map_image_info = info->diffuse_irradiance.vulkan_create_info(
-        vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc,
-        vk::ImageCreateFlagBits::eCubeCompatible
-    );
-
     // compute total input/output size of the job
-    auto in_size     = linear_image_size_in_bytes(src_image_info);
-    auto skybox_size = linear_image_size_in_bytes(sky_image_info);
-    auto out_size    = skybox_size + linear_image_size_in_bytes(diffuse_map_image_info);
-
-    info->diffuse_irradiance_offset = skybox_size;
+    auto in_size  = linear_image_size_in_bytes(src_image_info);
+    auto out_size = linear_image_size_in_bytes(sky_image_info);
 
     total_output_size = info->len = out_size;
 
@@ -88,18 +79,12 @@ environment_process_job::environment_process_job(
         info->skybox.vulkan_full_image_view(skybox->get(), vk::ImageViewType::eCube)
     );
 
-    diffuse_map      = std::make_unique<gpu_image>(alloc, diffuse_map_image_info);
-    diffuse_map_view = dev.createImageViewUnique(info->diffuse_irradiance.vulkan_full_image_view(
-        diffuse_map->get(), vk::ImageViewType::eCube
-    ));
-
     // create descriptor for resources
     vk::DescriptorSetLayout desc_set_layouts[] = {
         res->desc_set_layout.get(),
-        res->desc_set_layout.get(),
     };
     desc_sets = dev.allocateDescriptorSetsUnique(
-        vk::DescriptorSetAllocateInfo{res->desc_pool.get(), 2, desc_set_layouts}
+        vk::DescriptorSetAllocateInfo{res->desc_pool.get(), 1, desc_set_layouts}
     );
 
     vk::DescriptorImageInfo src_desc_info{
@@ -108,16 +93,10 @@ environment_process_job::environment_process_job(
     vk::DescriptorImageInfo sky_desc_info{
         VK_NULL_HANDLE, skybox_view.get(), vk::ImageLayout::eGeneral
     };
-    vk::DescriptorImageInfo diffuse_map_desc_info{
-        VK_NULL_HANDLE, diffuse_map_view.get(), vk::ImageLayout::eGeneral
-    };
     // set output for each compute job differently
     auto writes = std::vector<vk::WriteDescriptorSet>{
         vk::WriteDescriptorSet{
                                desc_sets[0].get(), 1, 0, 1, vk::DescriptorType::eStorageImage, &sky_desc_info
-        },
-        vk::WriteDescriptorSet{
-                               desc_sets[1].get(), 1, 0, 1, vk::DescriptorType::eStorageImage, &diffuse_map_desc_info
         }
     };
     // input for all compute jobs is the same
@@ -184,19 +163,17 @@ void environment_process_job::build_cmd_buffer(
                                vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1}
         }
     };
-    // also move the output cubemaps into general layout so we can write to it from the shader
-    for(auto i : {skybox->get(), diffuse_map->get()}) {
-        barriers.emplace_back(vk::ImageMemoryBarrier{
-            {},
-            vk::AccessFlagBits::eShaderWrite,
-            vk::ImageLayout::eUndefined,
-            vk::ImageLayout::eGeneral,
-            VK_QUEUE_FAMILY_IGNORED,
-            VK_QUEUE_FAMILY_IGNORED,
-            i,
-            vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 6}
-        });
-    }
+    // also move the output cubemap into general layout so we can write to it from the shader
+    barriers.emplace_back(vk::ImageMemoryBarrier{
+        {},
+        vk::AccessFlagBits::eShaderWrite,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eGeneral,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        skybox->get(),
+        vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 6}
+    });
     cmd_buffer.pipelineBarrier(
         vk::PipelineStageFlagBits::eTransfer,
         vk::PipelineStageFlagBits::eComputeShader,
@@ -218,41 +195,25 @@ void environment_process_job::build_cmd_buffer(
         sky_image_info.arrayLayers
     );
 
-    // run diffuse irradiance map generation shader
-    cmd_buffer.bindDescriptorSets(
-        vk::PipelineBindPoint::eCompute, res->pipeline_layout.get(), 0, desc_sets[1].get(), {}
-    );
-    cmd_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, res->diffuse_map_pipeline.get());
-    const uint32_t DIFFUSE_MAP_SHADER_LOCAL_SIZE = 32;
-    cmd_buffer.dispatch(
-        diffuse_map_image_info.extent.width / DIFFUSE_MAP_SHADER_LOCAL_SIZE,
-        diffuse_map_image_info.extent.height / DIFFUSE_MAP_SHADER_LOCAL_SIZE,
-        diffuse_map_image_info.arrayLayers
-    );
-
     // TODO: generate mipmaps for cubemaps
 
     // transition skybox to transfer src so we can copy it out
-    barriers.clear();
-    for(auto i : {skybox->get(), diffuse_map->get()}) {
-        barriers.emplace_back(vk::ImageMemoryBarrier{
+    cmd_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eTransfer,
+        {},
+        {},
+        {},
+        {vk::ImageMemoryBarrier{
             vk::AccessFlagBits::eShaderWrite,
             vk::AccessFlagBits::eTransferRead,
             vk::ImageLayout::eGeneral,
             vk::ImageLayout::eTransferSrcOptimal,
             VK_QUEUE_FAMILY_IGNORED,
             VK_QUEUE_FAMILY_IGNORED,
-            i,
+            skybox->get(),
             vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 6}
-        });
-    }
-    cmd_buffer.pipelineBarrier(
-        vk::PipelineStageFlagBits::eComputeShader,
-        vk::PipelineStageFlagBits::eTransfer,
-        {},
-        {},
-        {},
-        barriers
+        }}
     );
 
     // copy cubemap into staging buffer
@@ -268,18 +229,6 @@ void environment_process_job::build_cmd_buffer(
     cmd_buffer.copyImageToBuffer(
         skybox->get(), vk::ImageLayout::eTransferSrcOptimal, staging->get(), regions
     );
-
-    regions = copy_regions_for_linear_image2d(
-        diffuse_map_image_info.extent.width,
-        diffuse_map_image_info.extent.height,
-        diffuse_map_image_info.mipLevels,
-        diffuse_map_image_info.arrayLayers,
-        diffuse_map_image_info.format,
-        offset
-    );
-    cmd_buffer.copyImageToBuffer(
-        diffuse_map->get(), vk::ImageLayout::eTransferSrcOptimal, staging->get(), regions
-    );
 }
 
 const vk::DescriptorSetLayoutBinding desc_set_bindings[] = {
@@ -296,13 +245,6 @@ const vk::ShaderModuleCreateInfo skybox_shader_create_info{
     {}, sizeof(skybox_shader_bytecode), skybox_shader_bytecode
 };
 
-const uint32_t diffuse_map_shader_bytecode[] = {
-#include "diffuse_irradiance_map.comp.num"
-};
-const vk::ShaderModuleCreateInfo diffuse_map_shader_create_info{
-    {}, sizeof(diffuse_map_shader_bytecode), diffuse_map_shader_bytecode
-};
-
 vk::UniquePipeline create_compute_pipeline(
     vk::Device dev, vk::PipelineLayout pipeline_layout, vk::ShaderModule shader
 ) {
@@ -346,10 +288,6 @@ environment_process_job_resources::environment_process_job_resources(vk::Device
     skybox_pipeline
         = create_compute_pipeline(dev, pipeline_layout.get(), skybox_shader_module.get());
 
-    auto diffuse_map_shader_module = dev.createShaderModuleUnique(diffuse_map_shader_create_info);
-    diffuse_map_pipeline
-        = create_compute_pipeline(dev, pipeline_layout.get(), diffuse_map_shader_module.get());
-
     sampler = dev.createSamplerUnique(vk::SamplerCreateInfo{
         {}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eLinear
     });
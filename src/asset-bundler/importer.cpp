@@ -3,13 +3,31 @@
 #include "asset-bundler/texture_processor.h"
 #include "fs-shim.h"
 #include "glm/common.hpp"
+#include <assimp/DefaultIOSystem.h>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <future>
 #include <limits>
+#include <meshoptimizer.h>
+#include <set>
+#include <sstream>
+#ifdef __SSSE3__
+#    include <immintrin.h>
+#endif
 
 const std::unordered_set<std::string> texture_exts     = {".png", ".jpg", ".bmp"};
 const std::unordered_set<std::string> environment_exts = {".hdr"};
 
-importer::importer(output_bundle& out, const std::vector<std::filesystem::path>& input_paths)
-    : out(out) {
+importer::importer(
+    output_bundle& out, const std::vector<std::filesystem::path>& input_paths, const options& opts
+)
+    : out(out), optimize_meshes(opts.optimize_meshes), workers(opts.import_workers) {
+    num_workers = workers.size();
+    if(!opts.cache_dir.empty()) {
+        cache.emplace(opts.cache_dir);
+        cache_key_start = cache->start_key(opts);
+    }
     for(const auto& input : input_paths) {
         auto ext = path_to_string(input.extension());
         if(aimp.IsExtensionSupported(ext.c_str()))
@@ -23,6 +41,29 @@ importer::importer(output_bundle& out, const std::vector<std::filesystem::path>&
     }
 }
 
+texture_id importer::add_texture_source(texture_source src) {
+    // the same file is often referred to by different relative paths from different models
+    auto canonical = [](const path& p) {
+        std::error_code ec;
+        auto            cp = std::filesystem::weakly_canonical(p, ec);
+        return ec ? p : cp;
+    };
+    if(!src.main.empty()) src.main = canonical(src.main);
+    if(src.opacity.has_value()) src.opacity = canonical(*src.opacity);
+    for(auto& c : src.channels)
+        if(c.has_value()) c = canonical(*c);
+
+    auto existing = source_ids.find(src);
+    if(existing != source_ids.end()) {
+        duplicate_references[existing->second]++;
+        return existing->second;
+    }
+    auto id = out.reserve_texture_id();
+    source_ids.emplace(src, id);
+    textures.emplace(id, std::move(src));
+    return id;
+}
+
 glm::vec3 from_a(const aiVector3D& a) { return {a.x, a.y, a.z}; }
 
 mat4 from_a(const aiMatrix4x4& t) {
@@ -42,94 +83,149 @@ inline aabb aabb_from_ai(const aiAABB& bb) {
     };
 }
 
-void importer::load_mesh(const aiMesh* m, const aiScene* scene, size_t mat_index_offset) {
-    std::cout << "\t\t " << m->mName.C_Str() << " ("
-              << scene->mMaterials[m->mMaterialIndex]->GetName().C_Str() << ") " << m->mNumVertices
-              << " vertices, " << m->mNumFaces << " faces"
-              << " \n";
-    size_t vertex_offset = out.start_vertex_gather(m->mNumVertices);
+// reorder a mesh's triangles for the post-transform vertex cache and then for less overdraw, and
+// its vertices into the order they are first used so that vertex fetches are more local
+void optimize_mesh(
+    std::vector<vertex>& vertices, std::vector<index_type>& indices, std::ostream& log
+) {
+    // the statistics are for an NVIDIA-like cache of 16 vertices
+    auto before = meshopt_analyzeVertexCache(
+        indices.data(), indices.size(), vertices.size(), 16, 0, 0
+    );
+    meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertices.size());
+    // allow 5% more cache misses in exchange for less overdraw
+    meshopt_optimizeOverdraw(
+        indices.data(),
+        indices.data(),
+        indices.size(),
+        &vertices[0].position.x,
+        vertices.size(),
+        sizeof(vertex),
+        1.05f
+    );
+    meshopt_optimizeVertexFetch(
+        vertices.data(),
+        indices.data(),
+        indices.size(),
+        vertices.data(),
+        vertices.size(),
+        sizeof(vertex)
+    );
+    auto after = meshopt_analyzeVertexCache(
+        indices.data(), indices.size(), vertices.size(), 16, 0, 0
+    );
+    log << "\t\t\t ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+        << " -> " << after.atvr << "\n";
+}
+
+void import_mesh(
+    imported_model& model, const aiMesh* m, const aiScene* scene, bool optimize, std::ostream& log
+) {
+    log << "\t\t " << m->mName.C_Str() << " ("
+        << scene->mMaterials[m->mMaterialIndex]->GetName().C_Str() << ") " << m->mNumVertices
+        << " vertices, " << m->mNumFaces << " faces"
+        << " \n";
+    std::vector<vertex> vertices;
+    vertices.reserve(m->mNumVertices);
     for(size_t i = 0; i < m->mNumVertices; ++i) {
-        out.add_vertex(vertex{
+        vertices.emplace_back(vertex{
             .position  = from_a(m->mVertices[i]),
             .normal    = from_a(m->mNormals[i]),
             .tangent   = from_a(m->mTangents[i]),
             .tex_coord = glm::vec2(m->mTextureCoords[0][i].x, m->mTextureCoords[0][i].y)
         });
     }
-    auto   index_count  = m->mNumFaces * 3;
-    size_t index_offset = out.start_index_gather(index_count);
+    std::vector<index_type> indices;
+    indices.reserve(m->mNumFaces * 3);
     for(size_t f = 0; f < m->mNumFaces; ++f) {
         assert(m->mFaces[f].mNumIndices == 3);
         for(int i = 0; i < 3; ++i)
-            out.add_index(m->mFaces[f].mIndices[i]);
+            indices.emplace_back(m->mFaces[f].mIndices[i]);
     }
-    out.add_mesh(mesh_info{
-        .vertex_offset  = vertex_offset,
-        .index_offset   = index_offset,
-        .index_count    = index_count,
-        .material_index = m->mMaterialIndex + mat_index_offset,
+    if(optimize && !indices.empty()) optimize_mesh(vertices, indices, log);
+
+    model.meshes.emplace_back(mesh_info{
+        .vertex_offset  = (uint32_t)model.vertices.size(),
+        .index_offset   = (uint32_t)model.indices.size(),
+        .index_count    = (uint32_t)indices.size(),
+        .material_index = m->mMaterialIndex,
         .bounds         = aabb_from_ai(m->mAABB)
     });
+    model.vertices.insert(model.vertices.end(), vertices.begin(), vertices.end());
+    model.indices.insert(model.indices.end(), indices.begin(), indices.end());
 }
 
-// only support two levels: groups and objects? makes scene graphs simpler but ECS probably won't be
-// a scene graph itself????
-void importer::load_graph(const aiNode* node, aiMesh** const meshInfos) {
-    for(size_t i = 0; i < node->mNumChildren; ++i) {
-        auto* c = node->mChildren[i];
-        if(c->mNumMeshes > 0 && c->mNumChildren == 0)
-            load_object(c, meshInfos);
-        else
-            load_group(c, meshInfos);
+inline string_id add_name(imported_model& model, const aiString& name) {
+    model.names.emplace_back(name.C_Str());
+    return (string_id)(model.names.size() - 1);
+}
+
+inline texture_id add_texture_reference(imported_model& model, texture_source src) {
+    model.textures.emplace_back(std::move(src));
+    return (texture_id)model.textures.size();
+}
+
+std::pair<object_id, aabb> import_object(
+    imported_model& model, const aiNode* node, aiMesh** const meshInfos, std::ostream& log
+) {
+    log << "\t\t\t\t object: " << node->mName.C_Str() << " " << node->mNumMeshes << " meshes \n";
+    // if(!node->mTransformation.IsIdentity()) std::cout << "\t\t\t\t\t transform != identity\n";
+    std::vector<uint32_t> meshes;
+    meshes.reserve(node->mNumMeshes);
+    vec3 bound_min = vec3(std::numeric_limits<float>::max()),
+         bound_max = vec3(std::numeric_limits<float>::min());
+    for(size_t i = 0; i < node->mNumMeshes; ++i) {
+        meshes.emplace_back(node->mMeshes[i]);
+        const auto& b = meshInfos[node->mMeshes[i]]->mAABB;
+        bound_min     = glm::min(bound_min, from_a(b.mMin));
+        bound_max     = glm::max(bound_max, from_a(b.mMax));
     }
+    aabb      bounds{bound_min, bound_max};
+    mat4      t  = from_a(node->mTransformation);
+    object_id id = (object_id)model.objects.size();
+    model.objects.emplace_back(object_info{
+        .name         = add_name(model, node->mName),
+        .mesh_indices = meshes,
+        .transform    = t,
+        .bounds       = bounds
+    });
+    return {id, bounds.transformed(t)};
 }
 
-void importer::load_group(const aiNode* node, aiMesh** const meshInfos) {
-    std::cout << "\t\t\t group: " << node->mName.C_Str() << "\n";
+void import_group(
+    imported_model& model, const aiNode* node, aiMesh** const meshInfos, std::ostream& log
+) {
+    log << "\t\t\t group: " << node->mName.C_Str() << "\n";
     std::vector<object_id> members;
     members.reserve(node->mNumChildren);
     aabb bounds{vec3(std::numeric_limits<float>::max()), vec3(std::numeric_limits<float>::min())};
     for(size_t i = 0; i < node->mNumChildren; ++i) {
         auto* c = node->mChildren[i];
         if(c->mNumMeshes > 0 && c->mNumChildren == 0) {
-            auto [id, bb] = load_object(c, meshInfos);
+            auto [id, bb] = import_object(model, c, meshInfos, log);
             bounds.extend(bb);
             members.emplace_back(id);
         } else {
-            std::cout << "\t\t\t\t invalid subgroup " << c->mNumChildren << "\n";
+            log << "\t\t\t\t invalid subgroup " << c->mNumChildren << "\n";
         }
     }
-    out.add_group(group_info{
-        .name = out.add_string(node->mName.C_Str()), .objects = members, .bounds = bounds
+    model.groups.emplace_back(group_info{
+        .name = add_name(model, node->mName), .objects = members, .bounds = bounds
     });
 }
 
-std::pair<object_id, aabb> importer::load_object(const aiNode* node, aiMesh** const meshInfos) {
-    std::cout << "\t\t\t\t object: " << node->mName.C_Str() << " " << node->mNumMeshes
-              << " meshes \n";
-    // if(!node->mTransformation.IsIdentity()) std::cout << "\t\t\t\t\t transform != identity\n";
-    std::vector<uint32_t> meshes;
-    meshes.reserve(node->mNumMeshes);
-    vec3 bound_min = vec3(std::numeric_limits<float>::max()),
-         bound_max = vec3(std::numeric_limits<float>::min());
-    for(size_t i = 0; i < node->mNumMeshes; ++i) {
-        // !!! Assume that we load meshes after we load the graph
-        meshes.emplace_back(node->mMeshes[i] + out.num_meshes());
-        const auto& b = meshInfos[node->mMeshes[i]]->mAABB;
-        bound_min     = glm::min(bound_min, from_a(b.mMin));
-        bound_max     = glm::max(bound_max, from_a(b.mMax));
+// only support two levels: groups and objects? makes scene graphs simpler but ECS probably won't be
+// a scene graph itself????
+void import_graph(
+    imported_model& model, const aiNode* node, aiMesh** const meshInfos, std::ostream& log
+) {
+    for(size_t i = 0; i < node->mNumChildren; ++i) {
+        auto* c = node->mChildren[i];
+        if(c->mNumMeshes > 0 && c->mNumChildren == 0)
+            import_object(model, c, meshInfos, log);
+        else
+            import_group(model, c, meshInfos, log);
     }
-    aabb bounds{bound_min, bound_max};
-    mat4 t = from_a(node->mTransformation);
-    return {
-        out.add_object(object_info{
-            .name         = out.add_string(node->mName.C_Str()),
-            .mesh_indices = meshes,
-            .transform    = t,
-            .bounds       = bounds
-        }),
-        bounds.transformed(t)
-    };
 }
 
 path path_from_assimp(const aiString& tpath) {
@@ -139,130 +235,661 @@ path path_from_assimp(const aiString& tpath) {
     return tp;
 }
 
-void importer::load_model(const path& ip) {
-    std::cout << "\t" << ip << "\n";
-    // TODO: why does aiProcessPreset_TargetRealtime_MaxQuality seg fault because it doesn't
-    // generate tangents??
-    const aiScene* scene = aimp.ReadFile(
-        path_to_string(ip),
-        aiProcessPreset_TargetRealtime_Fast | aiProcess_FlipUVs | aiProcess_GenBoundingBoxes
-    );
-    std::cout << "\t\t" << scene->mNumMeshes << " meshes, " << scene->mNumMaterials
-              << " materials\n";
+// turn a scene that assimp has read into flat arrays, optimizing its meshes if asked to
+imported_model import_scene(const aiScene* scene, bool optimize_meshes) {
+    imported_model     model;
+    std::ostringstream log;
+    log << "\t\t" << scene->mNumMeshes << " meshes, " << scene->mNumMaterials << " materials\n";
 
-    load_graph(scene->mRootNode, scene->mMeshes);
+    import_graph(model, scene->mRootNode, scene->mMeshes, log);
 
-    size_t start_mat_index = out.num_materials();
     for(size_t i = 0; i < scene->mNumMeshes; ++i)
-        load_mesh(scene->mMeshes[i], scene, start_mat_index);
+        import_mesh(model, scene->mMeshes[i], scene, optimize_meshes, log);
 
     for(size_t i = 0; i < scene->mNumMaterials; ++i) {
         const auto*   mat = scene->mMaterials[i];
-        material_info info{out.add_string(mat->GetName().C_Str())};
+        material_info info{add_name(model, mat->GetName())};
         // TODO: read opacity map if present
         // TODO: convert all RGB8 textures to RGBA8 textures, using opacity map if possible
         aiString tpath;
         if(mat->GetTexture(aiTextureType_DIFFUSE, 0, &tpath) == aiReturn_SUCCESS) {
-            auto diffuse_path = path_from_assimp(tpath);
-            auto tid          = add_texture_path(ip.parent_path() / diffuse_path);
-            info.set_texture(aiTextureType_DIFFUSE, tid);
+            auto           diffuse_path = path_from_assimp(tpath);
+            texture_source diffuse{.main = diffuse_path};
             if(mat->GetTexture(aiTextureType_OPACITY, 0, &tpath) == aiReturn_SUCCESS) {
-                std::cout << "texture has opacity @ " << tpath.C_Str() << "\n";
+                log << "texture has opacity @ " << tpath.C_Str() << "\n";
                 auto opacity_path = path_from_assimp(tpath);
                 // Blender seems to write the DIFFUSE texture in to this slot if it has an alpha
                 // channel, which is redundant
-                if(diffuse_path != opacity_path)
-                    std::get<1>(textures[tid]) = ip.parent_path() / opacity_path;
+                if(diffuse_path != opacity_path) diffuse.opacity = opacity_path;
             }
+            info.set_texture(
+                aiTextureType_DIFFUSE, add_texture_reference(model, std::move(diffuse))
+            );
+        }
+        if(mat->GetTexture(aiTextureType_NORMALS, 0, &tpath) == aiReturn_SUCCESS) {
+            auto tid = add_texture_reference(
+                model,
+                texture_source{.main = path_from_assimp(tpath), .usage = texture_usage::normal_map}
+            );
+            info.set_texture(aiTextureType_NORMALS, tid);
+        }
+        // occlusion, roughness and metallic are packed into one texture so that the shader can
+        // fetch them all at once
+        texture_source orm{.usage = texture_usage::occlusion_roughness_metallic};
+        aiTextureType  orm_types[]
+            = {aiTextureType_AMBIENT_OCCLUSION, aiTextureType_SHININESS, aiTextureType_METALNESS};
+        for(size_t c = 0; c < orm.channels.size(); ++c) {
+            if(mat->GetTexture(orm_types[c], 0, &tpath) != aiReturn_SUCCESS) continue;
+            orm.channels[c] = path_from_assimp(tpath);
+            if(orm.main.empty()) orm.main = *orm.channels[c];
         }
-        for(auto tt : {aiTextureType_NORMALS, aiTextureType_METALNESS, aiTextureType_SHININESS})
-            if(mat->GetTexture(tt, 0, &tpath) == aiReturn_SUCCESS)
-                info.set_texture(tt, add_texture_path(ip.parent_path() / path_from_assimp(tpath)));
-        out.add_material(std::move(info));
+        if(!orm.main.empty())
+            info.occlusion_roughness_metallic = add_texture_reference(model, std::move(orm));
+        model.materials.emplace_back(std::move(info));
     }
+    model.messages = log.str();
+    return model;
 }
 
-bool texture_is_single_value(int w, int h, int channels, const stbi_uc* data) {
-    assert(channels <= 4);
-    for(int y = 0; y < h; ++y) {
-        for(int x = 0; x < w; ++x) {
-            for(int c = 0; c < channels; ++c)
-                if(data[c] != data[c + x * channels + y * w * channels]) return false;
+// assimp's file system, remembering every file that is opened so that the other files a model is
+// read from, like the materials of an OBJ, can be checked before its cache entry is used
+class recording_io_system : public Assimp::DefaultIOSystem {
+  public:
+    std::set<std::string> opened;
+
+    Assimp::IOStream* Open(const char* file, const char* mode = "rb") override {
+        auto* stream = DefaultIOSystem::Open(file, mode);
+        if(stream != nullptr) opened.emplace(file);
+        return stream;
+    }
+};
+
+void write_path(entry_writer& w, const path& p) { w.write(path_to_string(p)); }
+
+path read_path(entry_reader& r) {
+    std::string s;
+    r.read(s);
+    return s;
+}
+
+void write_optional_path(entry_writer& w, const std::optional<path>& p) {
+    w.write(p.has_value());
+    if(p.has_value()) write_path(w, *p);
+}
+
+std::optional<path> read_optional_path(entry_reader& r) {
+    bool present;
+    r.read(present);
+    if(!present) return {};
+    return read_path(r);
+}
+
+// store a model in the cache along with the digest of every other file it was read from. the model
+// is not stored if one of those files can't be read again
+void store_model(
+    const asset_cache&           cache,
+    const content_digest&        key,
+    const path&                  ip,
+    const imported_model&        model,
+    const std::set<std::string>& opened
+) {
+    std::vector<std::pair<path, content_digest>> dependencies;
+    for(const auto& file : opened) {
+        path p{file};
+        if(p.lexically_normal() == ip.lexically_normal()) continue;
+        content_hasher h;
+        if(!h.add_file(p)) return;
+        auto relative = p.lexically_relative(ip.parent_path());
+        dependencies.emplace_back(relative.empty() ? p : relative, h.key());
+    }
+
+    entry_writer w;
+    w.write(dependencies.size());
+    for(const auto& [p, digest] : dependencies) {
+        write_path(w, p);
+        w.write(digest);
+    }
+    w.write(model.vertices);
+    w.write(model.indices);
+    w.write(model.meshes);
+    w.write(model.materials.size());
+    for(const auto& m : model.materials)
+        w.write(m);
+    w.write(model.objects.size());
+    for(const auto& o : model.objects) {
+        w.write(o.name);
+        w.write(o.mesh_indices);
+        w.write(o.transform);
+        w.write(o.bounds);
+    }
+    w.write(model.groups.size());
+    for(const auto& g : model.groups) {
+        w.write(g.name);
+        w.write(g.objects);
+        w.write(g.bounds);
+    }
+    w.write(model.names.size());
+    for(const auto& n : model.names)
+        w.write(n);
+    w.write(model.textures.size());
+    for(const auto& t : model.textures) {
+        write_path(w, t.main);
+        write_optional_path(w, t.opacity);
+        w.write(t.usage);
+        for(const auto& c : t.channels)
+            write_optional_path(w, c);
+    }
+
+    cached_model_header header{.len = w.data().size()};
+    cache.store(key, &header, sizeof(header), w.data().data(), w.data().size());
+}
+
+// the model stored in a cache entry, if every other file it was read from is unchanged
+std::optional<imported_model> read_cached_model(entry_reader& r, const path& ip) {
+    size_t num_dependencies;
+    r.read(num_dependencies);
+    for(size_t i = 0; i < num_dependencies; ++i) {
+        auto           p = ip.parent_path() / read_path(r);
+        content_digest digest;
+        r.read(digest);
+        content_hasher h;
+        if(!h.add_file(p) || h.key() != digest) return {};
+    }
+
+    imported_model model;
+    r.read(model.vertices);
+    r.read(model.indices);
+    r.read(model.meshes);
+    size_t count;
+    r.read(count);
+    for(size_t i = 0; i < count; ++i) {
+        material_info m{INVALID_STRING};
+        r.read(m);
+        model.materials.emplace_back(m);
+    }
+    r.read(count);
+    for(size_t i = 0; i < count; ++i) {
+        object_info o;
+        r.read(o.name);
+        r.read(o.mesh_indices);
+        r.read(o.transform);
+        r.read(o.bounds);
+        model.objects.emplace_back(std::move(o));
+    }
+    r.read(count);
+    for(size_t i = 0; i < count; ++i) {
+        group_info g;
+        r.read(g.name);
+        r.read(g.objects);
+        r.read(g.bounds);
+        model.groups.emplace_back(std::move(g));
+    }
+    r.read(count);
+    for(size_t i = 0; i < count; ++i)
+        r.read(model.names.emplace_back());
+    r.read(count);
+    for(size_t i = 0; i < count; ++i) {
+        texture_source t;
+        t.main    = read_path(r);
+        t.opacity = read_optional_path(r);
+        r.read(t.usage);
+        for(auto& c : t.channels)
+            c = read_optional_path(r);
+        model.textures.emplace_back(std::move(t));
+    }
+
+    std::ostringstream log;
+    log << "\t\t" << model.meshes.size() << " meshes, " << model.materials.size()
+        << " materials\n\t\tfound imported model in cache\n";
+    model.messages = log.str();
+    return model;
+}
+
+// read and import a model, or find it in the asset cache if cache is not null, with an assimp
+// importer of its own so that many can be read at once. the key covers the model file and whether
+// its meshes are optimized. vertices are quantized from the imported ones as the bundle is
+// written, so that option doesn't change what is cached here
+imported_model import_model(
+    const path& ip, bool optimize_meshes, const asset_cache* cache, content_hasher key
+) {
+    std::optional<content_digest> cache_key;
+    if(cache != nullptr) {
+        key.add_value(optimize_meshes);
+        if(key.add_file(ip)) {
+            cache_key  = key.key();
+            auto entry = cache->load<cached_model_header>(*cache_key);
+            if(entry.has_value()) {
+                std::optional<imported_model> model;
+                try {
+                    entry_reader r{entry->second, entry->first.len};
+                    model = read_cached_model(r, ip);
+                } catch(const std::runtime_error&) {
+                    // a malformed entry, which is replaced below
+                }
+                free(entry->second);
+                if(model.has_value()) return std::move(*model);
+            }
         }
     }
-    return true;
+
+    Assimp::Importer aimp;
+    // the importer owns its file system
+    auto* io = new recording_io_system;
+    aimp.SetIOHandler(io);
+    // TODO: why does aiProcessPreset_TargetRealtime_MaxQuality seg fault because it doesn't
+    // generate tangents??
+    const auto* scene = aimp.ReadFile(
+        path_to_string(ip),
+        aiProcessPreset_TargetRealtime_Fast | aiProcess_FlipUVs | aiProcess_GenBoundingBoxes
+    );
+    if(scene == nullptr) {
+        imported_model failed;
+        failed.error = aimp.GetErrorString();
+        return failed;
+    }
+    auto model = import_scene(scene, optimize_meshes);
+    if(cache_key.has_value()) store_model(*cache, *cache_key, ip, model, io->opened);
+    return model;
+}
+
+void importer::add_model(const path& ip, imported_model&& model) {
+    std::cout << "\t" << ip << "\n" << model.messages;
+
+    std::vector<string_id> names;
+    names.reserve(model.names.size());
+    for(const auto& n : model.names)
+        names.emplace_back(out.add_string(n));
+
+    std::vector<texture_id> texture_ids;
+    texture_ids.reserve(model.textures.size());
+    auto dir = ip.parent_path();
+    for(auto& src : model.textures) {
+        if(!src.main.empty()) src.main = dir / src.main;
+        if(src.opacity.has_value()) src.opacity = dir / *src.opacity;
+        for(auto& c : src.channels)
+            if(c.has_value()) c = dir / *c;
+        texture_ids.emplace_back(add_texture_source(std::move(src)));
+    }
+
+    size_t                 mesh_offset = out.num_meshes(), material_offset = out.num_materials();
+    std::vector<object_id> object_ids;
+    object_ids.reserve(model.objects.size());
+    for(auto& o : model.objects) {
+        o.name = names[o.name];
+        for(auto& m : o.mesh_indices)
+            m += (uint32_t)mesh_offset;
+        object_ids.emplace_back(out.add_object(std::move(o)));
+    }
+    for(auto& g : model.groups) {
+        g.name = names[g.name];
+        for(auto& o : g.objects)
+            o = object_ids[o];
+        out.add_group(std::move(g));
+    }
+
+    size_t vertex_offset = out.start_vertex_gather(model.vertices.size());
+    for(auto& v : model.vertices)
+        out.add_vertex(std::move(v));
+    size_t index_offset = out.start_index_gather(model.indices.size());
+    for(auto i : model.indices)
+        out.add_index(i);
+    for(auto& m : model.meshes) {
+        m.vertex_offset += (uint32_t)vertex_offset;
+        m.index_offset += (uint32_t)index_offset;
+        m.material_index += (uint32_t)material_offset;
+        out.add_mesh(std::move(m));
+    }
+
+    for(auto& m : model.materials) {
+        m.name = names[m.name];
+        for(texture_id* t : {&m.base_color, &m.normals, &m.occlusion_roughness_metallic})
+            if(*t != INVALID_TEXTURE) *t = texture_ids[*t - 1];
+        out.add_material(std::move(m));
+    }
+}
+
+inline double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// a texture is a single value if it is equal to itself shifted over by one texel
+bool texture_is_single_value(int w, int h, int channels, const stbi_uc* data) {
+    assert(channels <= 4);
+    size_t size = (size_t)w * h * channels;
+    return size <= (size_t)channels || memcmp(data, data + channels, size - channels) == 0;
 }
 
 stbi_uc* insert_alpha_channel_into_rgb8(int width, int height, stbi_uc* data, stbi_uc* alpha) {
-    stbi_uc* new_data = (stbi_uc*)malloc(width * height * 4);
-    for(int y = 0; y < height; ++y) {
-        for(int x = 0; x < width; ++x) {
-            for(int c = 0; c < 3; ++c)
-                new_data[c + x * 4 + y * width * 4] = data[c + x * 3 + y * width * 3];
-            new_data[3 + x * 4 + y * width * 4] = alpha == nullptr ? 0xff : alpha[x + y * width];
+    size_t   num_texels = (size_t)width * height;
+    stbi_uc* new_data   = (stbi_uc*)malloc(num_texels * 4);
+    size_t   i          = 0;
+#ifdef __SSSE3__
+    // expand 4 texels at a time, reading 16 bytes so the last 4 texels are done one by one
+    const __m128i spread_rgb
+        = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i spread_a
+        = _mm_setr_epi8(-1, -1, -1, 0, -1, -1, -1, 1, -1, -1, -1, 2, -1, -1, -1, 3);
+    const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+    for(; i + 6 <= num_texels; i += 4) {
+        __m128i rgb = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 3)), spread_rgb);
+        __m128i a   = opaque;
+        if(alpha != nullptr) {
+            uint32_t a4;
+            memcpy(&a4, alpha + i, sizeof(a4));
+            a = _mm_shuffle_epi8(_mm_cvtsi32_si128((int)a4), spread_a);
         }
+        _mm_storeu_si128((__m128i*)(new_data + i * 4), _mm_or_si128(rgb, a));
+    }
+#endif
+    for(; i < num_texels; ++i) {
+        new_data[i * 4 + 0] = data[i * 3 + 0];
+        new_data[i * 4 + 1] = data[i * 3 + 1];
+        new_data[i * 4 + 2] = data[i * 3 + 2];
+        new_data[i * 4 + 3] = alpha == nullptr ? 0xff : alpha[i];
     }
     return new_data;
 }
 
-void importer::load_texture(texture_id id, const std::tuple<path, std::optional<path>>& ip) {
-    const auto& [main_texture_path, opacity_texture_path] = ip;
-    std::cout << "\t" << main_texture_path << " (" << id << ") \n";
-    int   width, height, channels;
-    auto* data = stbi_load(
-        path_to_string(main_texture_path).c_str(), &width, &height, &channels, STBI_default
+// the size of the texels that will be stored for a texture, which for textures shrunk to a single
+// texel is only the first one
+size_t texels_size(const decoded_texture& t) { return (size_t)t.width * t.height * t.channels; }
+
+// decode the maps of a packed occlusion/roughness/metallic texture into the channels of one RGBA8
+// texture. missing maps are filled in as no occlusion, fully rough and not metallic
+decoded_texture decode_packed_texture(const texture_source& src) {
+    auto start = std::chrono::steady_clock::now();
+
+    decoded_texture    t;
+    std::ostringstream log;
+    auto               finish = [&] {
+        t.messages    = log.str();
+        t.decode_time = seconds_since(start);
+        if(t.data != nullptr) t.texel_digest = sha256_of(t.data, texels_size(t));
+        return std::move(t);
+    };
+    const stbi_uc defaults[3] = {0xff, 0xff, 0x00};
+    stbi_uc*      maps[3]     = {};
+    for(size_t c = 0; c < src.channels.size(); ++c) {
+        if(!src.channels[c].has_value()) continue;
+        const auto& p = src.channels[c].value();
+        int         w, h;
+        maps[c] = stbi_load(path_to_string(p).c_str(), &w, &h, nullptr, STBI_grey);
+        if(maps[c] == nullptr) {
+            log << "\t\tfailed to load texture " << p << ": " << stbi_failure_reason() << "\n";
+        } else if(t.width == 0) {
+            t.width  = w;
+            t.height = h;
+        } else if(w != t.width || h != t.height) {
+            log << "warning: expected " << p << " to be the same size as the other maps packed "
+                << "with it " << w << "x" << h << " vs " << t.width << "x" << t.height << "\n";
+            free(maps[c]);
+            maps[c] = nullptr;
+        }
+    }
+    if(t.width == 0) return finish();
+
+    t.channels   = 4;
+    t.num_texels = (size_t)t.width * t.height;
+    auto* data   = (stbi_uc*)malloc(t.num_texels * 4);
+    for(size_t i = 0; i < t.num_texels; ++i) {
+        for(size_t c = 0; c < 3; ++c)
+            data[i * 4 + c] = maps[c] != nullptr ? maps[c][i] : defaults[c];
+        data[i * 4 + 3] = 0xff;
+    }
+    for(auto* m : maps)
+        free(m);
+    log << "\t\tpacked occlusion/roughness/metallic texture " << t.width << "x" << t.height
+        << "\n";
+    if(texture_is_single_value(t.width, t.height, 4, data)) {
+        t.width  = 1;
+        t.height = 1;
+    }
+    t.data = data;
+    return finish();
+}
+
+// decode a texture and convert it to the format the texture processor expects
+// this runs on a worker thread, so messages are collected to be printed in order later
+decoded_texture decode_texture(const texture_source& src) {
+    if(src.usage == texture_usage::occlusion_roughness_metallic) return decode_packed_texture(src);
+    auto start = std::chrono::steady_clock::now();
+
+    const auto& main_texture_path    = src.main;
+    const auto& opacity_texture_path = src.opacity;
+
+    decoded_texture    t;
+    std::ostringstream log;
+    auto               finish = [&] {
+        t.messages    = log.str();
+        t.decode_time = seconds_since(start);
+        if(t.data != nullptr) t.texel_digest = sha256_of(t.data, texels_size(t));
+        return std::move(t);
+    };
+    stbi_uc* data = stbi_load(
+        path_to_string(main_texture_path).c_str(), &t.width, &t.height, &t.channels, STBI_default
     );
     if(data == nullptr) {
-        std::cout << "\t\tfailed to load texture " << main_texture_path << ": "
-                  << stbi_failure_reason() << "\n";
-        return;
+        log << "\t\tfailed to load texture " << main_texture_path << ": "
+            << stbi_failure_reason() << "\n";
+        return finish();
     }
     stbi_uc* opacity_data = nullptr;
     if(opacity_texture_path.has_value()) {
-        if(channels != 3) {
-            std::cout << "warning: loading opacity map (" << opacity_texture_path.value()
-                      << ") for texture with " << channels << " channels, which is unsupported\n";
+        if(t.channels != 3) {
+            log << "warning: loading opacity map (" << opacity_texture_path.value()
+                << ") for texture with " << t.channels << " channels, which is unsupported\n";
         }
         int ax, ay;
         opacity_data = stbi_load(
             path_to_string(opacity_texture_path.value()).c_str(), &ax, &ay, nullptr, STBI_grey
         );
         if(opacity_data == nullptr) {
-            std::cout << "\t\tfailed to load texture " << opacity_texture_path.value() << ": "
-                      << stbi_failure_reason() << "\n";
-            return;
+            log << "\t\tfailed to load texture " << opacity_texture_path.value() << ": "
+                << stbi_failure_reason() << "\n";
+            free(data);
+            return finish();
         }
-        if(ax != width || ay != height) {
-            std::cout << "warning: expected opacity map (" << opacity_texture_path.value()
-                      << ") to be the same size as base texture" << ax << "x" << ay << " vs "
-                      << width << "x" << height << "\n";
+        if(ax != t.width || ay != t.height) {
+            log << "warning: expected opacity map (" << opacity_texture_path.value()
+                << ") to be the same size as base texture" << ax << "x" << ay << " vs "
+                << t.width << "x" << t.height << "\n";
             free(opacity_data);
             opacity_data = nullptr;
         }
     }
-    std::cout << "\t\tloaded texture " << width << "x" << height << " c=" << channels << "\n";
+    log << "\t\tloaded texture " << t.width << "x" << t.height << " c=" << t.channels << "\n";
+    t.num_texels = (size_t)t.width * t.height;
     // check if the texture is silly and we can store it as a single texel
     // the output stage will truncate the data when it copies it into the file
-    if(texture_is_single_value(width, height, channels, data)
-       && (opacity_data == nullptr || texture_is_single_value(width, height, 1, opacity_data))) {
-        width  = 1;
-        height = 1;
+    if(texture_is_single_value(t.width, t.height, t.channels, data)
+       && (opacity_data == nullptr
+           || texture_is_single_value(t.width, t.height, 1, opacity_data))) {
+        t.width  = 1;
+        t.height = 1;
     }
-    if(channels == 3) {
-        auto* new_data = insert_alpha_channel_into_rgb8(width, height, data, opacity_data);
+    if(t.channels == 3) {
+        auto* new_data = insert_alpha_channel_into_rgb8(t.width, t.height, data, opacity_data);
         free(data);
-        free(opacity_data);
-        data     = new_data;
-        channels = 4;
+        data       = new_data;
+        t.channels = 4;
     }
-    // TODO: possibly we could also apply compression with stb_dxt and save more VRAM
-    out.add_texture(
-        id, path_to_string(main_texture_path.filename()), width, height, channels, data
-    );
+    free(opacity_data);
+    t.data = data;
+    return finish();
+}
+
+// look up the processed texture in the cache, or decode it and work out the key to cache it under
+// this runs on a worker thread like decode_texture
+decoded_texture load_texture(
+    const texture_source& src, const asset_cache* cache, content_hasher key
+) {
+    if(cache == nullptr) return decode_texture(src);
+    auto start = std::chrono::steady_clock::now();
+
+    // the key covers the contents of every file the texture is made from
+    key.add_value(src.usage);
+    auto add_file = [&](const std::optional<path>& p) {
+        key.add_value(p.has_value());
+        return !p.has_value() || key.add_file(*p);
+    };
+    bool readable = add_file(src.main) && add_file(src.opacity);
+    for(const auto& c : src.channels)
+        readable = readable && add_file(c);
+    // decoding will report the missing file
+    if(!readable) return decode_texture(src);
+
+    auto entry = cache->load<cached_texture_header>(key.key());
+    if(entry.has_value()) {
+        const auto&     [header, data] = *entry;
+        decoded_texture t;
+        t.width        = header.width;
+        t.height       = header.height;
+        t.channels     = header.channels;
+        t.texel_digest = header.texel_digest;
+        t.processed    = header;
+        t.data         = data;
+        t.messages     = "\t\tfound processed texture in cache\n";
+        t.decode_time  = seconds_since(start);
+        return t;
+    }
+    auto t = decode_texture(src);
+    if(t.data != nullptr)
+        t.cache_entry
+            = texture_cache_entry{key.key(), t.width, t.height, t.channels, t.texel_digest};
+    return t;
+}
+
+// whether a texture has exactly the same texels as the one decoded from existing. digests only
+// find the candidates, so the texels are decoded again and compared before one texture replaces
+// another. textures found in the cache only have their processed data, so they are decoded too
+bool same_texels(
+    const texture_source& existing, const texture_source& src, const decoded_texture& t
+) {
+    auto            e = decode_texture(existing);
+    decoded_texture redecoded;
+    const auto*     n = &t;
+    if(t.processed.has_value()) {
+        redecoded = decode_texture(src);
+        n         = &redecoded;
+    }
+    bool same = e.data != nullptr && n->data != nullptr && e.width == n->width
+                && e.height == n->height && e.channels == n->channels
+                && memcmp(e.data, n->data, texels_size(e)) == 0;
+    free(e.data);
+    free(redecoded.data);
+    return same;
+}
+
+void importer::load_textures() {
+    // textures are decoded on the worker pool, with at most num_workers decoded textures
+    // waiting to be handed to the texture processor. they are handed over in id order so that the
+    // bundle is the same no matter how many threads are used
+    std::deque<std::future<decoded_texture>> decoding;
+    auto                                     next_decode = textures.begin();
+    double decode_time = 0.0, wait_time = 0.0, submit_time = 0.0;
+    size_t num_texels = 0;
+    auto   start      = std::chrono::steady_clock::now();
+    // textures that decode to the same texels are only stored once, by the first id they were
+    // decoded for
+    std::map<std::tuple<content_digest, int, int, int, texture_usage>, texture_id> content_ids;
+    size_t num_content_duplicates = 0, dedup_saved_bytes = 0, num_cached = 0;
+    const asset_cache* c = cache.has_value() ? &*cache : nullptr;
+    for(const auto& [id, ip] : textures) {
+        while(next_decode != textures.end() && decoding.size() < num_workers) {
+            const auto& src = next_decode->second;
+            decoding.emplace_back(workers.submit([&src, c, key = cache_key_start] {
+                return load_texture(src, c, key);
+            }));
+            ++next_decode;
+        }
+        auto wait_start = std::chrono::steady_clock::now();
+        auto t          = decoding.front().get();
+        decoding.pop_front();
+        wait_time += seconds_since(wait_start);
+        decode_time += t.decode_time;
+
+        std::cout << "\t" << ip.main << " (" << id << ") \n" << t.messages;
+        if(t.data == nullptr) continue;
+        size_t references = 1 + duplicate_references[id];
+        auto   content    = std::tuple{t.texel_digest, t.width, t.height, t.channels, ip.usage};
+        auto   existing   = content_ids.find(content);
+        if(existing != content_ids.end() && !same_texels(textures.at(existing->second), ip, t)) {
+            std::cout << "\t\tsame digest as texture " << existing->second
+                      << " but different contents\n";
+            existing = content_ids.end();
+        }
+        if(existing != content_ids.end()) {
+            std::cout << "\t\tsame contents as texture " << existing->second << "\n";
+            free(t.data);
+            out.remap_texture(id, existing->second);
+            num_content_duplicates++;
+            dedup_saved_bytes += out.texture_size(existing->second) * references;
+            continue;
+        }
+        content_ids.try_emplace(content, id);
+        if(t.processed.has_value()) {
+            out.add_processed_texture(
+                id,
+                path_to_string(ip.main.filename()),
+                t.processed->img,
+                t.data,
+                t.processed->len,
+                ip.usage
+            );
+            num_cached++;
+            dedup_saved_bytes += out.texture_size(id) * (references - 1);
+            continue;
+        }
+        num_texels += t.num_texels;
+        auto submit_start = std::chrono::steady_clock::now();
+        out.add_texture(
+            id,
+            path_to_string(ip.main.filename()),
+            t.width,
+            t.height,
+            t.channels,
+            t.data,
+            ip.usage,
+            t.cache_entry
+        );
+        submit_time += seconds_since(submit_start);
+        dedup_saved_bytes += out.texture_size(id) * (references - 1);
+    }
+    double total_time = seconds_since(start);
+    double mtexels    = (double)num_texels / 1e6;
+    std::cout << "decoded " << textures.size() << " textures (" << mtexels << " Mtexels) in "
+              << total_time << "s on " << num_workers << " threads: decode "
+              << mtexels / std::max(decode_time, 1e-9) << " Mtexels/s per thread, submit "
+              << mtexels / std::max(submit_time, 1e-9) << " Mtexels/s, waited " << wait_time
+              << "s for decodes\n";
+    if(cache.has_value())
+        std::cout << "found " << num_cached << " of " << textures.size()
+                  << " processed textures in cache\n";
+    size_t num_path_duplicates = 0;
+    for(const auto& [id, n] : duplicate_references)
+        num_path_duplicates += n;
+    std::cout << "deduplicated " << num_path_duplicates << " texture references by path and "
+              << num_content_duplicates << " textures by content, saving "
+              << (double)dedup_saved_bytes / (1024.0 * 1024.0) << " MiB\n";
 }
 
 void importer::load_env(const path& ip) {
     std::cout << "\t" << ip << "\n";
+    std::optional<content_digest> cache_key;
+    if(cache.has_value()) {
+        auto key = cache_key_start;
+        if(key.add_file(ip)) {
+            auto entry = cache->load<cached_environment_header>(key.key());
+            if(entry.has_value()) {
+                std::cout << "\t\tfound processed environment in cache\n";
+                out.add_processed_environment(
+                    path_to_string(ip.filename()), entry->first, entry->second
+                );
+                return;
+            }
+            cache_key = key.key();
+        }
+    }
     int   width, height, channels;
     auto* data = stbi_loadf(path_to_string(ip).c_str(), &width, &height, &channels, STBI_rgb_alpha);
     if(data == nullptr) {
@@ -270,17 +897,32 @@ void importer::load_env(const path& ip) {
                   << "\n";
         return;
     }
-    out.add_environment(path_to_string(ip.filename()), width, height, 4, data);
+    out.add_environment(path_to_string(ip.filename()), width, height, 4, data, cache_key);
 }
 
 void importer::load() {
     std::cout << "loading models:\n";
-    for(const auto& ip : models)
-        load_model(ip);
+    // models are read and imported on the worker pool, but added to the bundle one at a time in
+    // input order, so that the bundle is identical to one where they were loaded one after another
+    std::deque<std::future<imported_model>> importing;
+    size_t                                  next_import = 0;
+    const asset_cache*                      c           = cache.has_value() ? &*cache : nullptr;
+    for(const auto& ip : models) {
+        while(next_import < models.size() && importing.size() < num_workers)
+            importing.emplace_back(workers.submit([this, &ip = models[next_import++], c] {
+                return import_model(ip, optimize_meshes, c, cache_key_start);
+            }));
+        auto model = importing.front().get();
+        importing.pop_front();
+        if(model.error.has_value()) {
+            std::cout << "\tfailed to load model " << ip << ": " << *model.error << "\n";
+            continue;
+        }
+        add_model(ip, std::move(model));
+    }
 
     std::cout << "loading textures:\n";
-    for(const auto& [id, ip] : textures)
-        load_texture(id, ip);
+    load_textures();
 
     std::cout << "loading environments:\n";
     for(const auto& ip : environments)
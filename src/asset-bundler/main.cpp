@@ -1,3 +1,4 @@
+#include "asset-bundler/dictionary.h"
 #include "asset-bundler/importer.h"
 #include "asset-bundler/model.h"
 #include "asset-bundler/output_bundle.h"
@@ -12,31 +13,145 @@
  *      - represent them in a uniform way
  *      - bundle them so they can be loaded quickly
  *  usage:
- *      asset-bundler <output bundle name> <input assets>...
+ *      asset-bundler [options] <output bundle name> <input assets>...
+ *      asset-bundler --train-dictionary [--dictionary-size <KiB>] <output dictionary> <bundles>...
+ *  options:
+ *      --import-workers <n>    number of models or textures read at once, defaults to one per
+ *                              core
+ *      --no-mesh-opt           keep triangles and vertices in the order they were authored
+ *      --quantize-vertices     store compact 20-byte vertices instead of full 44-byte ones
+ *      --uncompressed-textures store textures as RGBA8 instead of block compressing them
+ *      --cpu-mips              generate mip levels on the CPU even if there is a GPU, which is
+ *                              what happens anyway without one
+ *      --mip-filter <filter>   box (the default) or lanczos, which is sharper but CPU only
+ *      --cpu-env               process environments on the CPU even if there is a GPU
+ *      --cache <dir>           reuse imported models and processed textures and environments
+ *                              from earlier runs, keyed by the contents of their source files
+ *      --level <n>             zstd compression level, defaults to the fastest level
+ *      --workers <n>           number of compression threads, defaults to one per core
+ *      --long                  enable zstd long distance matching
+ *      --window-log <n>        log2 of the zstd window size
+ *      --frame-size <KiB>      size of each independently compressed frame, defaults to 1 MiB
+ *      --dictionary <path>     compress with a dictionary made by --train-dictionary
+ *      --codec <sections>=<codec>
+ *                              codec for a kind of section: cpu, texture, environment, vertices,
+ *                              indices, gpu (every section but cpu) or all
+ *                              codec is zstd (the default), lz4 or stored
+ *  a fast iteration build needs no options, a shipping build might use something like
+ *      --level 19 --long --window-log 27 --frame-size 65536
+ *  for machines with fast disks but slow CPUs, something like
+ *      --codec texture=stored --codec vertices=lz4 --codec indices=lz4
+ *  trades bundle size for load speed
+ *  with --cache, a rebuild after editing a few textures only processes those textures again.
+ *  models are still read every time
+ *  the window is limited by the frame size, so long distance matching and a large window only
+ *  help with large frames
+ *  many small bundles that share content compress better with a shared dictionary, trained from
+ *  bundles built without one. the game then has to load them with the same dictionary
  */
+
+// parse a --codec argument of the form <sections>=<codec>
+void set_codec(options& opts, const std::string& arg) {
+    using asset_bundle_format::section_codec;
+    using asset_bundle_format::section_type;
+    const char* section_names[] = {"cpu", "texture", "environment", "vertices", "indices"};
+
+    size_t split = arg.find('=');
+    if(split == std::string::npos)
+        throw std::runtime_error("expected <sections>=<codec> for --codec, got " + arg);
+    std::string sections = arg.substr(0, split), codec_name = arg.substr(split + 1);
+
+    std::optional<section_codec> codec;
+    for(size_t c = 0; c < (size_t)section_codec::NUM_CODECS; ++c)
+        if(codec_name == asset_bundle_format::SECTION_CODEC_NAMES[c]) codec = (section_codec)c;
+    if(!codec.has_value()) throw std::runtime_error("unknown codec " + codec_name);
+
+    bool matched = false;
+    for(size_t t = 0; t < (size_t)section_type::NUM_TYPES; ++t) {
+        if(sections == "all" || (sections == "gpu" && t != (size_t)section_type::cpu)
+           || sections == section_names[t]) {
+            opts.codecs[t] = *codec;
+            matched        = true;
+        }
+    }
+    if(!matched) throw std::runtime_error("unknown kind of section " + sections);
+}
+
+// parse a --mip-filter argument
+mip_filter parse_mip_filter(const std::string& name) {
+    if(name == "box") return mip_filter::box;
+    if(name == "lanczos") return mip_filter::lanczos;
+    throw std::runtime_error("unknown mip filter " + name);
+}
+
 int main(int argc, char* argv[]) {
     if(argc < 2) {
-        std::cout << "usage:\n\tasset-bundler <output bundle path> <input asset path>...\n";
+        std::cout << "usage:\n\tasset-bundler [--import-workers <n>] "
+                     "[--no-mesh-opt] [--quantize-vertices] [--uncompressed-textures] "
+                     "[--cpu-mips] [--mip-filter <filter>] [--cpu-env] [--cache <dir>] "
+                     "[--level <n>] [--workers <n>] "
+                     "[--long] [--window-log <n>] [--frame-size <KiB>] [--dictionary <path>] "
+                     "[--codec <sections>=<codec>] <output bundle path> <input asset path>...\n"
+                     "\tasset-bundler --train-dictionary [--dictionary-size <KiB>] <output "
+                     "dictionary path> <input bundle path>...\n";
         return -1;
     }
 
     std::filesystem::path              output_path;
     std::vector<std::filesystem::path> input_paths;
     options                            opts;
+    bool                               train = false;
 
     for(int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
-        if(arg == "--no-ibl-precomp")
-            opts.enable_ibl_precomputation = false;
+        if(arg == "--import-workers" && i + 1 < argc)
+            opts.import_workers = std::stoul(argv[++i]);
+        else if(arg == "--no-mesh-opt")
+            opts.optimize_meshes = false;
+        else if(arg == "--quantize-vertices")
+            opts.quantize_vertices = true;
+        else if(arg == "--uncompressed-textures")
+            opts.compress_textures = false;
+        else if(arg == "--cpu-mips")
+            opts.cpu_mips = true;
+        else if(arg == "--mip-filter" && i + 1 < argc)
+            opts.mips_filter = parse_mip_filter(argv[++i]);
+        else if(arg == "--cpu-env")
+            opts.cpu_environments = true;
+        else if(arg == "--cache" && i + 1 < argc)
+            opts.cache_dir = argv[++i];
+        else if(arg == "--level" && i + 1 < argc)
+            opts.compression_level = std::stoi(argv[++i]);
+        else if(arg == "--workers" && i + 1 < argc)
+            opts.compression_workers = std::stoul(argv[++i]);
+        else if(arg == "--long")
+            opts.long_distance_matching = true;
+        else if(arg == "--window-log" && i + 1 < argc)
+            opts.window_log = std::stoi(argv[++i]);
+        else if(arg == "--frame-size" && i + 1 < argc)
+            opts.frame_size = std::stoul(argv[++i]) * 1024;
+        else if(arg == "--dictionary" && i + 1 < argc)
+            opts.dictionary = argv[++i];
+        else if(arg == "--codec" && i + 1 < argc)
+            set_codec(opts, argv[++i]);
+        else if(arg == "--train-dictionary")
+            train = true;
+        else if(arg == "--dictionary-size" && i + 1 < argc)
+            opts.max_dictionary_size = std::stoul(argv[++i]) * 1024;
         else if(output_path.empty())
             output_path = arg;
         else
             input_paths.emplace_back(arg);
     }
 
+    if(train) {
+        train_dictionary(output_path, input_paths, opts);
+        return 0;
+    }
+
     texture_processor tex_proc{opts};
-    output_bundle     out{output_path, &tex_proc};
-    importer          imp{out, input_paths};
+    output_bundle     out{output_path, &tex_proc, opts};
+    importer          imp{out, input_paths, opts};
     imp.load();
     out.write();
     return 0;
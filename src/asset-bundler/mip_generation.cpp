@@ -0,0 +1,174 @@
+#include "asset-bundler/mip_generation.h"
+#include "asset-bundler/parallel.h"
+#include "egg/renderer/memory.h"
+#include <array>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+#include <vulkan/vulkan_format_traits.hpp>
+#ifdef __SSE2__
+#    include <emmintrin.h>
+#endif
+
+// a level and the level above it that it is made from
+struct level_pair {
+    const uint8_t* src;
+    uint32_t       src_width, src_height;
+    uint8_t*       dest;
+    uint32_t       width, height;
+    size_t         nchannels;
+};
+
+// average each 2x2 square of texels, repeating the last row or column of levels that are only
+// one texel wide or tall
+void box_filter_rows(const level_pair& l, uint32_t first_row, uint32_t last_row) {
+    size_t n = l.nchannels;
+    for(uint32_t y = first_row; y < last_row; ++y) {
+        size_t         y0  = std::min(2 * y, l.src_height - 1);
+        size_t         y1  = std::min(2 * y + 1, l.src_height - 1);
+        const uint8_t* r0  = l.src + y0 * l.src_width * n;
+        const uint8_t* r1  = l.src + y1 * l.src_width * n;
+        uint8_t*       out = l.dest + (size_t)y * l.width * n;
+        uint32_t       x   = 0;
+#ifdef __SSE2__
+        // four RGBA texels at a time, from eight texels of each row
+        if(n == 4 && l.src_width >= 2) {
+            const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+            // sum the 2x2 squares of texels in a pair of rows of four texels, as 16-bit channels
+            auto square_sums = [&](__m128i a, __m128i b) {
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                lo         = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                hi         = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                return _mm_unpacklo_epi64(lo, hi);
+            };
+            for(; x + 4 <= l.width; x += 4) {
+                __m128i a0  = _mm_loadu_si128((const __m128i*)(r0 + x * 8));
+                __m128i a1  = _mm_loadu_si128((const __m128i*)(r0 + x * 8 + 16));
+                __m128i b0  = _mm_loadu_si128((const __m128i*)(r1 + x * 8));
+                __m128i b1  = _mm_loadu_si128((const __m128i*)(r1 + x * 8 + 16));
+                __m128i t01 = _mm_srli_epi16(_mm_add_epi16(square_sums(a0, b0), two), 2);
+                __m128i t23 = _mm_srli_epi16(_mm_add_epi16(square_sums(a1, b1), two), 2);
+                _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(t01, t23));
+            }
+        }
+#endif
+        for(; x < l.width; ++x) {
+            size_t x0 = std::min(2 * x, l.src_width - 1) * n;
+            size_t x1 = std::min(2 * x + 1, l.src_width - 1) * n;
+            for(size_t c = 0; c < n; ++c)
+                out[x * n + c]
+                    = (uint8_t)((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) / 4);
+        }
+    }
+}
+
+// the taps of a Lanczos (a = 2) filter that halves a level, for source texels 2x - 3 to 2x + 4
+const size_t LANCZOS_TAPS = 8;
+
+std::array<float, LANCZOS_TAPS> lanczos_weights() {
+    auto sinc = [](float t) {
+        if(t == 0.f) return 1.f;
+        float pt = glm::pi<float>() * t;
+        return std::sin(pt) / pt;
+    };
+    std::array<float, LANCZOS_TAPS> w;
+    float                           total = 0.f;
+    for(size_t i = 0; i < LANCZOS_TAPS; ++i) {
+        // distance of the tap from the center of the output texel, in output texels
+        float t = ((float)i - 3.5f) / 2.f;
+        w[i]    = sinc(t) * sinc(t / 2.f);
+        total += w[i];
+    }
+    for(auto& wi : w)
+        wi /= total;
+    return w;
+}
+
+// filter the texel at x of a row of a level. a row that is only one texel long is copied
+void lanczos_texel(const uint8_t* row, uint32_t src_width, uint32_t x, size_t n, float* out) {
+    static const auto weights = lanczos_weights();
+    for(size_t c = 0; c < n; ++c)
+        out[c] = src_width == 1 ? (float)row[c] : 0.f;
+    if(src_width == 1) return;
+    for(size_t i = 0; i < LANCZOS_TAPS; ++i) {
+        int64_t sx = std::clamp<int64_t>(2 * (int64_t)x + (int64_t)i - 3, 0, src_width - 1);
+        const uint8_t* texel = row + sx * n;
+        for(size_t c = 0; c < n; ++c)
+            out[c] += weights[i] * (float)texel[c];
+    }
+}
+
+// make a level with the separable Lanczos filter, first along every source row into a float
+// buffer and then across whole rows of that, so that both passes read memory in order
+void lanczos_filter_level(const level_pair& l, std::vector<float>& rows, worker_pool& workers) {
+    static const auto weights    = lanczos_weights();
+    size_t            n          = l.nchannels;
+    size_t            row_stride = (size_t)l.width * n;
+    rows.resize(l.src_height * row_stride);
+    parallel_rows(l.src_height, workers, [&](uint32_t first, uint32_t last) {
+        for(uint32_t y = first; y < last; ++y) {
+            const uint8_t* src = l.src + (size_t)y * l.src_width * n;
+            for(uint32_t x = 0; x < l.width; ++x)
+                lanczos_texel(src, l.src_width, x, n, rows.data() + y * row_stride + x * n);
+        }
+    });
+    parallel_rows(l.height, workers, [&](uint32_t first, uint32_t last) {
+        std::vector<float> sum(row_stride);
+        for(uint32_t y = first; y < last; ++y) {
+            if(l.src_height == 1) {
+                std::copy(rows.begin(), rows.begin() + row_stride, sum.begin());
+            } else {
+                std::fill(sum.begin(), sum.end(), 0.f);
+                for(size_t i = 0; i < LANCZOS_TAPS; ++i) {
+                    int64_t sy
+                        = std::clamp<int64_t>(2 * (int64_t)y + (int64_t)i - 3, 0, l.src_height - 1);
+                    const float* row = rows.data() + sy * row_stride;
+                    for(size_t j = 0; j < row_stride; ++j)
+                        sum[j] += weights[i] * row[j];
+                }
+            }
+            uint8_t* out = l.dest + y * row_stride;
+            for(size_t j = 0; j < row_stride; ++j)
+                out[j] = (uint8_t)std::clamp(sum[j] + 0.5f, 0.f, 255.f);
+        }
+    });
+}
+
+void generate_mip_chain(
+    uint8_t*     levels,
+    vk::Format   format,
+    uint32_t     width,
+    uint32_t     height,
+    uint32_t     mip_levels,
+    mip_filter   filter,
+    worker_pool& workers
+) {
+    size_t nchannels = vk::blockSize(format);
+    if(vk::componentBits(format, 0) != 8 || nchannels > 4)
+        throw std::runtime_error(
+            "unsupported format for CPU mip generation " + vk::to_string(format)
+        );
+    std::vector<float> rows;
+    for(uint32_t level = 1; level < mip_levels; ++level) {
+        level_pair l{
+            .src        = levels,
+            .src_width  = width,
+            .src_height = height,
+            .dest       = levels + image_level_size_in_bytes(width, height, format),
+            .width      = std::max(width / 2, 1u),
+            .height     = std::max(height / 2, 1u),
+            .nchannels  = nchannels
+        };
+        switch(filter) {
+            case mip_filter::box:
+                parallel_rows(l.height, workers, [&](uint32_t first, uint32_t last) {
+                    box_filter_rows(l, first, last);
+                });
+                break;
+            case mip_filter::lanczos: lanczos_filter_level(l, rows, workers); break;
+        }
+        levels = l.dest;
+        width  = l.width;
+        height = l.height;
+    }
+}
@@ -1,241 +1,909 @@
 #include "asset-bundler/output_bundle.h"
+#include "asset-bundler/dictionary.h"
 #include "asset-bundler/format.h"
+#include "asset-bundler/parallel.h"
 #include "asset-bundler/texture_processor.h"
 #include "fs-shim.h"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>
+#include <future>
+#include <glm/gtc/packing.hpp>
+#include <limits>
+#include <lz4.h>
+#include <memory>
+#include <numeric>
+#include <tuple>
 #include <zstd.h>
 
 void output_bundle::add_texture(
+    texture_id                         id,
+    const std::string&                 name,
+    uint32_t                           width,
+    uint32_t                           height,
+    int                                nchannels,
+    stbi_uc*                           data,
+    texture_usage                      usage,
+    std::optional<texture_cache_entry> cache_entry
+) {
+    string_id    ns = add_string(std::move(name));
+    texture_info info{ns, width, height, format_from_channels(nchannels), data, usage};
+    if(cache.has_value()) info.cache_entry = cache_entry;
+    // the texture processor may fill in the processed data later, so it is given the copy in the
+    // map, which stays put
+    tex_proc->submit_texture(id, &textures.emplace(id, info).first->second);
+}
+
+void output_bundle::add_processed_texture(
     texture_id         id,
     const std::string& name,
-    uint32_t           width,
-    uint32_t           height,
-    int                nchannels,
-    stbi_uc*           data
+    const image_info&  img,
+    stbi_uc*           data,
+    size_t             len,
+    texture_usage      usage
 ) {
     string_id    ns = add_string(std::move(name));
-    texture_info info{ns, width, height, format_from_channels(nchannels), data};
-    tex_proc->submit_texture(id, &info);
+    texture_info info{ns, img.width, img.height, img.format, data, usage};
+    info.img = img;
+    info.len = len;
     textures.emplace(id, info);
 }
 
+void output_bundle::remap_texture(texture_id from, texture_id to) {
+    for(auto& m : materials)
+        for(texture_id* t : {&m.base_color, &m.normals, &m.occlusion_roughness_metallic})
+            if(*t == from) *t = to;
+}
+
+void output_bundle::compact_texture_ids() {
+    // the texture map's nodes are moved rather than copied, so the texture processor's pointers
+    // into them stay valid
+    std::map<texture_id, texture_id>   new_ids;
+    std::map<texture_id, texture_info> compacted;
+    texture_id                         next_id = 1;
+    while(!textures.empty()) {
+        auto node = textures.extract(textures.begin());
+        new_ids.emplace(node.key(), next_id);
+        node.key() = next_id++;
+        compacted.insert(std::move(node));
+    }
+    textures        = std::move(compacted);
+    next_texture_id = next_id;
+    // references to textures that were never added, like ones that failed to load, are dropped
+    for(auto& m : materials) {
+        for(texture_id* t : {&m.base_color, &m.normals, &m.occlusion_roughness_metallic}) {
+            if(*t == INVALID_TEXTURE) continue;
+            auto n = new_ids.find(*t);
+            *t     = n != new_ids.end() ? n->second : INVALID_TEXTURE;
+        }
+    }
+}
+
 void output_bundle::add_environment(
-    const std::string& name, uint32_t width, uint32_t height, int nchannels, float* data
+    const std::string&            name,
+    uint32_t                      width,
+    uint32_t                      height,
+    int                           nchannels,
+    float*                        data,
+    std::optional<content_digest> cache_key
 ) {
     string_id ns   = add_string(std::move(name));
-    auto      info = tex_proc->submit_environment(ns, width, height, nchannels, data);
+    auto      info
+        = tex_proc->submit_environment(environments.size(), ns, width, height, nchannels, data);
+    if(cache.has_value()) info.cache_key = cache_key;
     environments.emplace_back(info);
 }
 
-std::pair<size_t, size_t> output_bundle::total_and_header_size() const {
-    size_t total = sizeof(asset_bundle_format::header);
-    total += sizeof(asset_bundle_format::string_header) * strings.size();
-    total += sizeof(asset_bundle_format::texture_header) * textures.size();
-    total += sizeof(asset_bundle_format::material_header) * materials.size();
-    total += sizeof(asset_bundle_format::mesh_header) * meshes.size();
-    total += sizeof(asset_bundle_format::object_header) * objects.size();
-    total += sizeof(asset_bundle_format::group_header) * groups.size();
-    total += sizeof(asset_bundle_format::environment_header) * environments.size();
-    total += (16 - (total % 16)) % 16;  // add padding to align data on a 16-byte boundary
-    size_t header_size = total;
+void output_bundle::add_processed_environment(
+    const std::string& name, const cached_environment_header& processed, stbi_uc* data
+) {
+    environments.emplace_back(environment_info{
+        .name                  = add_string(name),
+        .skybox                = processed.skybox,
+        .diffuse_irradiance_sh = processed.diffuse_irradiance_sh,
+        .len                   = processed.len,
+        .data                  = data
+    });
+}
+
+size_t output_bundle::layout_cpu_section(asset_bundle_format::header& h) const {
+    size_t size = sizeof(asset_bundle_format::header);
+    // reserve space for a table starting on a 16-byte boundary and return its offset
+    auto table = [&](size_t item_size, size_t count) {
+        size += (16 - (size % 16)) % 16;
+        auto offset = (uint32_t)size;
+        size += item_size * count;
+        if(size > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("bundle CPU section is too large for 32-bit offsets");
+        return offset;
+    };
 
+    // the string bytes directly follow the string headers
+    size_t string_bytes = 0;
     for(const auto& s : strings)
-        total += s.second.size();
-    for(const auto& t : textures)
-        total += t.second.len;
+        string_bytes += s.second.size();
+    h.strings_offset
+        = table(1, sizeof(asset_bundle_format::string_header) * strings.size() + string_bytes);
+
+    h.textures_offset = table(sizeof(asset_bundle_format::texture_header), textures.size());
+    h.environments_offset
+        = table(sizeof(asset_bundle_format::environment_header), environments.size());
+    h.materials_offset = table(sizeof(asset_bundle_format::material_header), materials.size());
+    h.meshes_offset    = table(sizeof(asset_bundle_format::mesh_header), meshes.size());
+
+    size_t num_object_mesh_indices = 0;
     for(const auto& o : objects)
-        total += o.mesh_indices.size() * sizeof(uint32_t);
-    for(const auto& o : groups)
-        total += o.objects.size() * sizeof(object_id);
-    for(const auto& e : environments)
-        total += e.len;
-    if(!environments.empty())  // add some extra space for padding.
-        total += 16;
-    total += sizeof(vertex) * vertices.size();
-    total += sizeof(index_type) * indices.size();
-    return {header_size, total};
+        num_object_mesh_indices += o.mesh_indices.size();
+    h.object_names_offset = table(sizeof(string_id), objects.size());
+    h.object_transforms_offset
+        = table(sizeof(asset_bundle_format::affine_transform), objects.size());
+    h.object_bounds_offset       = table(sizeof(aabb), objects.size());
+    h.object_meshes_offset       = table(sizeof(asset_bundle_format::index_range), objects.size());
+    h.object_mesh_indices_offset = table(sizeof(uint32_t), num_object_mesh_indices);
+
+    size_t num_group_object_indices = 0;
+    for(const auto& g : groups)
+        num_group_object_indices += g.objects.size();
+    h.group_names_offset          = table(sizeof(string_id), groups.size());
+    h.group_bounds_offset         = table(sizeof(aabb), groups.size());
+    h.group_objects_offset        = table(sizeof(asset_bundle_format::index_range), groups.size());
+    h.group_object_indices_offset = table(sizeof(object_id), num_group_object_indices);
+
+    for(size_t i = 0; i < name_tables.size(); ++i) {
+        const auto& t = name_tables[i];
+        h.name_tables[i] = asset_bundle_format::name_table{
+            .num_buckets  = (uint32_t)t.seeds.size(),
+            .num_slots    = (uint32_t)t.slots.size(),
+            .seeds_offset = table(sizeof(uint32_t), t.seeds.size()),
+            .slots_offset = table(sizeof(asset_bundle_format::name_slot), t.slots.size()),
+        };
+    }
+    return size;
+}
+
+std::vector<asset_bundle_format::section_header> output_bundle::layout_gpu_sections() const {
+    std::vector<asset_bundle_format::section_header> sections;
+    size_t                                           gpu_offset = 0;
+    auto add_section = [&](asset_bundle_format::section_type type, uint32_t index, size_t size) {
+        // align every section on a 16-byte boundary in the GPU data
+        gpu_offset += (16 - (gpu_offset % 16)) % 16;
+        sections.emplace_back(asset_bundle_format::section_header{
+            .type = type, .index = index, .uncompressed_size = size, .gpu_offset = gpu_offset
+        });
+        gpu_offset += size;
+    };
+    for(const auto& [id, t] : textures)
+        add_section(asset_bundle_format::section_type::texture, id, t.len);
+    for(uint32_t i = 0; i < environments.size(); ++i)
+        add_section(asset_bundle_format::section_type::environment, i, environments[i].len);
+    add_section(
+        asset_bundle_format::section_type::vertices,
+        0,
+        opts.quantize_vertices ? quantized_vertices.size() * sizeof(quantized_vertex)
+                               : vertices.size() * sizeof(vertex)
+    );
+    add_section(
+        asset_bundle_format::section_type::indices,
+        sizeof(index_type),
+        indices.size() * sizeof(index_type)
+    );
+    add_section(
+        asset_bundle_format::section_type::indices,
+        sizeof(short_index_type),
+        short_indices.size() * sizeof(short_index_type)
+    );
+    return sections;
+}
+
+// map a unit vector onto the octahedron and unfold it into a square, as 16-bit snorms
+inline std::array<int16_t, 2> encode_octahedral(vec3 n) {
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    // degenerate vectors decode to +z
+    if(l1 == 0.f) return {0, 0};
+    vec2 e = vec2(n.x, n.y) / l1;
+    if(n.z < 0.f) {
+        vec2 sign = vec2(e.x >= 0.f ? 1.f : -1.f, e.y >= 0.f ? 1.f : -1.f);
+        e         = (1.f - glm::abs(vec2(e.y, e.x))) * sign;
+    }
+    e = glm::round(glm::clamp(e, -1.f, 1.f) * 32767.f);
+    return {(int16_t)e.x, (int16_t)e.y};
 }
 
+// convert every vertex to the quantized layout, with its position relative to the bounds of the
+// mesh that uses it
+// each mesh's vertices are the run from its vertex offset up to its largest index, which is how the
+// importer adds them, so a vertex shared between meshes is quantized with the bounds of the last
+void output_bundle::quantize_vertices() {
+    quantized_vertices.assign(vertices.size(), quantized_vertex{});
+    for(auto& m : meshes) {
+        if(m.index_count == 0) continue;
+        auto first = indices.begin() + m.index_offset;
+        auto count = (size_t)*std::max_element(first, first + m.index_count) + 1;
+        // widen the bounds in case the mesh's vertices are not all inside them
+        for(size_t i = m.vertex_offset; i < m.vertex_offset + count; ++i) {
+            m.bounds.min = glm::min(m.bounds.min, vertices[i].position);
+            m.bounds.max = glm::max(m.bounds.max, vertices[i].position);
+        }
+        // flat axes quantize to 0 rather than dividing by zero
+        vec3 scale = 1.f / glm::max(m.bounds.max - m.bounds.min, vec3(FLT_MIN));
+        for(size_t i = m.vertex_offset; i < m.vertex_offset + count; ++i) {
+            const auto& v = vertices[i];
+            vec3        p = glm::clamp((v.position - m.bounds.min) * scale, 0.f, 1.f);
+            p             = glm::round(p * 65535.f);
+            auto n = encode_octahedral(v.normal), t = encode_octahedral(v.tangent);
+            quantized_vertices[i] = quantized_vertex{
+                .position  = {(uint16_t)p.x, (uint16_t)p.y, (uint16_t)p.z, 0},
+                .normal    = {n[0], n[1]},
+                .tangent   = {t[0], t[1]},
+                .tex_coord = {glm::packHalf1x16(v.tex_coord.x), glm::packHalf1x16(v.tex_coord.y)}
+            };
+        }
+    }
+    std::cout << "vertex data " << vertices.size() * sizeof(vertex) << " -> "
+              << quantized_vertices.size() * sizeof(quantized_vertex) << " bytes\n";
+}
+
+// move the indices of every mesh that only needs 16 bits into the short index pool
+// mesh indices are relative to the mesh's vertex offset, so this only depends on its vertex count
+void output_bundle::split_short_indices() {
+    size_t                  index_bytes = indices.size() * sizeof(index_type);
+    std::vector<index_type> long_indices;
+    for(auto& m : meshes) {
+        auto first = indices.begin() + m.index_offset, last = first + m.index_count;
+        bool fits  = std::all_of(first, last, [](index_type i) {
+            return i <= std::numeric_limits<short_index_type>::max();
+        });
+        if(fits) {
+            m.index_offset = (uint32_t)short_indices.size();
+            m.index_size   = sizeof(short_index_type);
+            short_indices.insert(short_indices.end(), first, last);
+        } else {
+            m.index_offset = (uint32_t)long_indices.size();
+            m.index_size   = sizeof(index_type);
+            long_indices.insert(long_indices.end(), first, last);
+        }
+    }
+    indices = std::move(long_indices);
+    size_t split_bytes
+        = indices.size() * sizeof(index_type) + short_indices.size() * sizeof(short_index_type);
+    std::cout << "index data " << index_bytes << " -> " << split_bytes << " bytes, "
+              << short_indices.size() << " of " << indices.size() + short_indices.size()
+              << " indices are 16-bit\n";
+}
+
+// compresses frames on a pool of worker threads and writes them to the file in order
+// at most one frame per worker is in flight at a time, so memory use stays bounded
+class frame_compressor {
+    struct slot {
+        ZSTD_CCtx*          cctx = nullptr;
+        std::vector<byte>   output;
+        std::future<size_t> compressed_size;
+        // keeps the section data alive until the frame has been compressed
+        std::shared_ptr<const byte> data;
+        size_t                      frame;
+        // stored frames are written straight from the section data
+        const byte*                 stored = nullptr;
+    };
+
+    FILE*                                           f;
+    // tracked here rather than with ftell, which is limited to a long
+    uint64_t                                        file_offset;
+    std::vector<asset_bundle_format::frame_header>& frames;
+    size_t                                          max_frame_size;
+    std::vector<slot>                               slots;
+    size_t                                          next_frame = 0, next_retired = 0;
+    // declared last so that its threads are joined before the slots they use are destroyed
+    worker_pool                                     workers;
+
+    void set_parameter(ZSTD_CCtx* cctx, ZSTD_cParameter param, int value) {
+        size_t result = ZSTD_CCtx_setParameter(cctx, param, value);
+        if(ZSTD_isError(result))
+            throw std::runtime_error(
+                std::string("invalid compression parameter: ") + ZSTD_getErrorName(result)
+            );
+    }
+
+    // wait for the oldest frame in flight and write it to the file
+    void retire() {
+        auto&  s    = slots[next_retired % slots.size()];
+        size_t size = s.compressed_size.get();
+        frames[s.frame] = asset_bundle_format::frame_header{
+            .file_offset = file_offset, .compressed_size = size
+        };
+        const byte* src = s.stored != nullptr ? s.stored : s.output.data();
+        if(fwrite(src, 1, size, f) != size)
+            throw std::runtime_error("failed to write bundle section");
+        file_offset += size;
+        s.data.reset();
+        next_retired++;
+    }
+
+  public:
+    frame_compressor(
+        const options&                                  opts,
+        const std::vector<byte>&                        dictionary,
+        FILE*                                           f,
+        uint64_t                                        file_offset,
+        std::vector<asset_bundle_format::frame_header>& frames
+    )
+        : f(f), file_offset(file_offset), frames(frames), max_frame_size(opts.frame_size),
+          workers(opts.compression_workers) {
+        slots.resize(workers.size());
+        for(auto& s : slots) {
+            s.cctx = ZSTD_createCCtx();
+            if(s.cctx == nullptr)
+                throw std::runtime_error("failed to create zstd compression context");
+            set_parameter(
+                s.cctx,
+                ZSTD_c_compressionLevel,
+                opts.compression_level.value_or(ZSTD_minCLevel() + 2)
+            );
+            if(opts.long_distance_matching)
+                set_parameter(s.cctx, ZSTD_c_enableLongDistanceMatching, 1);
+            if(opts.window_log != 0) set_parameter(s.cctx, ZSTD_c_windowLog, opts.window_log);
+            // the dictionary is digested once per context and reused for every frame after that
+            if(!dictionary.empty()) {
+                size_t result
+                    = ZSTD_CCtx_loadDictionary(s.cctx, dictionary.data(), dictionary.size());
+                if(ZSTD_isError(result))
+                    throw std::runtime_error(
+                        std::string("failed to load dictionary: ") + ZSTD_getErrorName(result)
+                    );
+            }
+            s.output.resize(std::max(
+                ZSTD_compressBound(max_frame_size), (size_t)LZ4_compressBound((int)max_frame_size)
+            ));
+        }
+    }
+
+    frame_compressor(const frame_compressor&)            = delete;
+    frame_compressor& operator=(const frame_compressor&) = delete;
+
+    ~frame_compressor() {
+        // frames still in flight reference the contexts, so wait for them before freeing
+        for(auto& s : slots) {
+            if(s.compressed_size.valid()) s.compressed_size.wait();
+            ZSTD_freeCCtx(s.cctx);
+        }
+    }
+
+    // queue one frame to be compressed and written after all the frames queued before it
+    // owner keeps src alive until the frame has been compressed
+    void compress_frame(
+        asset_bundle_format::section_codec codec,
+        std::shared_ptr<const byte>        owner,
+        const byte*                        src,
+        size_t                             size
+    ) {
+        if(next_frame - next_retired == slots.size()) retire();
+        auto& s  = slots[next_frame % slots.size()];
+        s.data   = std::move(owner);
+        s.frame  = next_frame++;
+        s.stored = nullptr;
+        switch(codec) {
+            case asset_bundle_format::section_codec::zstd:
+                s.compressed_size = workers.submit([&s, src, size] {
+                    size_t result
+                        = ZSTD_compress2(s.cctx, s.output.data(), s.output.size(), src, size);
+                    if(ZSTD_isError(result))
+                        throw std::runtime_error(
+                            std::string("failed to compress bundle section: ")
+                            + ZSTD_getErrorName(result)
+                        );
+                    return result;
+                });
+                break;
+            case asset_bundle_format::section_codec::lz4:
+                if(size > LZ4_MAX_INPUT_SIZE)
+                    throw std::runtime_error("frame size is too large for LZ4");
+                s.compressed_size = workers.submit([&s, src, size] {
+                    int result = LZ4_compress_default(
+                        (const char*)src, (char*)s.output.data(), (int)size, (int)s.output.size()
+                    );
+                    if(result <= 0) throw std::runtime_error("failed to compress bundle section");
+                    return (size_t)result;
+                });
+                break;
+            case asset_bundle_format::section_codec::stored:
+                s.stored          = src;
+                s.compressed_size = std::async(std::launch::deferred, [size] { return size; });
+                break;
+            default: assert(false);
+        }
+    }
+
+    // queue every frame of a section that is already entirely in memory
+    void compress_section(
+        const asset_bundle_format::section_header& section, const std::shared_ptr<const byte>& data
+    ) {
+        assert(section.first_frame == next_frame);
+        for(size_t offset = 0; offset < section.uncompressed_size; offset += max_frame_size)
+            compress_frame(
+                section.codec,
+                data,
+                data.get() + offset,
+                std::min(max_frame_size, section.uncompressed_size - offset)
+            );
+    }
+
+    size_t   frame_size() const { return max_frame_size; }
+    // where the next frame will be written, which is the size of the file once it is finished
+    uint64_t end_offset() const { return file_offset; }
+    size_t frames_queued() const { return next_frame; }
+
+    // write out all frames still in flight
+    void finish() {
+        while(next_retired < next_frame)
+            retire();
+    }
+};
+
+// cuts a section that is produced piece by piece into frames as it is written, so that only the
+// frames that are being compressed are ever held in memory
+class section_writer {
+    frame_compressor&                  compressor;
+    asset_bundle_format::section_codec codec;
+    size_t                             size, written = 0;
+    std::shared_ptr<byte>              frame;
+    size_t                             frame_used = 0;
+
+    void flush() {
+        compressor.compress_frame(codec, frame, frame.get(), frame_used);
+        frame.reset();
+        frame_used = 0;
+    }
+
+  public:
+    section_writer(frame_compressor& compressor, const asset_bundle_format::section_header& section)
+        : compressor(compressor), codec(section.codec), size(section.uncompressed_size) {
+        assert(section.first_frame == compressor.frames_queued());
+    }
+
+    size_t offset() const { return written; }
+
+    void write(const void* data, size_t count) {
+        assert(written + count <= size);
+        const size_t frame_size = compressor.frame_size();
+        while(count > 0) {
+            if(frame == nullptr) {
+                frame = std::shared_ptr<byte>((byte*)malloc(frame_size), free);
+                if(frame == nullptr) throw std::runtime_error("out of memory");
+            }
+            size_t n = std::min(count, frame_size - frame_used);
+            memcpy(frame.get() + frame_used, data, n);
+            data = (const byte*)data + n;
+            count -= n;
+            frame_used += n;
+            written += n;
+            if(frame_used == frame_size) flush();
+        }
+    }
+
+    template<typename T>
+    void write(const T& value) {
+        write(&value, sizeof(T));
+    }
+
+    // zero fill up to an offset from the start of the section
+    void pad_to(size_t offset) {
+        assert(offset >= written);
+        const byte zeros[16] = {};
+        while(written < offset)
+            write(zeros, std::min(sizeof(zeros), offset - written));
+    }
+
+    void finish() {
+        assert(written == size);
+        if(frame_used > 0) flush();
+    }
+};
+
 void output_bundle::write() {
-    // compute total uncompressed size & allocate buffer (RIP this might use a lot of RAM)
-    auto [header_size, total_size] = total_and_header_size();
-    std::cout << "bundle total size " << total_size << " bytes\n";
-    byte* buffer = (byte*)malloc(total_size);
-    assert(buffer != nullptr);
-
-    // copy data into buffer in correct format
-    std::cout << "copying data...\n";
-    auto* header = (asset_bundle_format::header*)buffer;
-    *header
-        = {.num_strings        = strings.size(),
-           .num_textures       = textures.size(),
-           .num_materials      = materials.size(),
-           .num_meshes         = meshes.size(),
-           .num_objects        = objects.size(),
-           .num_groups         = groups.size(),
-           .num_environments   = environments.size(),
-           .num_total_vertices = vertices.size(),
-           .num_total_indices  = indices.size(),
-           .data_offset        = header_size};
+    if(opts.frame_size == 0) throw std::runtime_error("bundle frame size must be nonzero");
+    std::vector<byte> dictionary;
+    uint32_t          dictionary_id = 0;
+    if(!opts.dictionary.empty()) {
+        std::tie(dictionary, dictionary_id) = load_dictionary(opts.dictionary);
+        std::cout << "compressing with dictionary " << dictionary_id << "\n";
+    }
+    compact_texture_ids();
+    build_name_tables();
+    // quantization finds each mesh's vertices through its indices, so it has to come first
+    if(opts.quantize_vertices) quantize_vertices();
+    split_short_indices();
+    // compute the layout of the GPU sections so that the CPU tables can refer to them
+    auto gpu_sections = layout_gpu_sections();
+
+    asset_bundle_format::header header{
+        .num_strings              = (uint32_t)strings.size(),
+        .num_textures             = (uint32_t)textures.size(),
+        .num_materials            = (uint32_t)materials.size(),
+        .num_meshes               = (uint32_t)meshes.size(),
+        .num_objects              = (uint32_t)objects.size(),
+        .num_groups               = (uint32_t)groups.size(),
+        .num_environments         = (uint32_t)environments.size(),
+        .num_total_vertices       = (uint32_t)vertices.size(),
+        .num_total_indices        = (uint32_t)indices.size(),
+        .num_total_short_indices  = (uint32_t)short_indices.size(),
+        .vertex_layout            = opts.quantize_vertices
+                                        ? asset_bundle_format::vertex_format::quantized
+                                        : asset_bundle_format::vertex_format::full,
+        .vertex_start_offset      = gpu_sections[gpu_sections.size() - 3].gpu_offset,
+        .index_start_offset       = gpu_sections[gpu_sections.size() - 2].gpu_offset,
+        .short_index_start_offset = gpu_sections[gpu_sections.size() - 1].gpu_offset,
+        .gpu_data_size = gpu_sections.back().gpu_offset + gpu_sections.back().uncompressed_size
+    };
+    size_t total_size = layout_cpu_section(header);
+    std::cout << "bundle CPU section size " << total_size << " bytes\n";
     std::cout << "creating a bundle with\n"
-              << "\t# strings = " << header->num_strings << "\n"
-              << "\t# textures = " << header->num_textures << "\n"
-              << "\t# materials = " << header->num_materials << "\n"
-              << "\t# meshes = " << header->num_meshes << "\n"
-              << "\t# objects = " << header->num_objects << "\n"
-              << "\t# groups = " << header->num_groups << "\n"
-              << "\t# environments = " << header->num_environments << "\n";
-
-    byte* header_ptr = buffer + sizeof(asset_bundle_format::header);
-    byte* data_ptr   = buffer + header_size;
-    // CPU only data
-    copy_strings(header_ptr, data_ptr, buffer);
-    copy_materials(header_ptr);
-    copy_meshes(header_ptr);
-    copy_objects(header_ptr, data_ptr, buffer);
-    copy_groups(header_ptr, data_ptr, buffer);
-
-    // everything that needs to go on the GPU (CPU headers will also be in the same order)
-    // TODO: we could easily eliminate this field by just passing `buffer + header_size` as `top`
-    // and including it in the offset for each resource
-    header->gpu_data_offset = (size_t)(data_ptr - buffer);
-    copy_textures(header_ptr, data_ptr, buffer);
-
-    if(!environments.empty()) {
-        // add padding to make sure we start aligned in the new section
-        auto env_padding = (16 - ((size_t)data_ptr % 16)) % 16;
-        data_ptr += env_padding;
-        total_size -= 16 - env_padding;
-        copy_environments(header_ptr, data_ptr, buffer);
-    }
-
-    header->vertex_start_offset = (size_t)(data_ptr - buffer);
-    memcpy(data_ptr, vertices.data(), vertices.size() * sizeof(vertex));
-    data_ptr += vertices.size() * sizeof(vertex);
-
-    header->index_start_offset = (size_t)(data_ptr - buffer);
-    memcpy(data_ptr, indices.data(), indices.size() * sizeof(index_type));
-    data_ptr += indices.size() * sizeof(index_type);
-
-    std::cout << (data_ptr - buffer) << " == " << total_size << " "
-              << ((data_ptr - buffer) - total_size) << "\n";
-    assert((data_ptr - buffer) == total_size);
-
-    // compress data and write it to file
-    std::cout << "compressing bundle...\n";
-    size_t compressed_buffer_size = ZSTD_compressBound(total_size);
-    byte*  compressed_buffer      = (byte*)malloc(compressed_buffer_size);
-    // TODO: make compression level configurable
-    size_t actual_compressed_size = ZSTD_compress(
-        compressed_buffer, compressed_buffer_size, buffer, total_size, ZSTD_minCLevel() + 2
-    );
-    free(buffer);
-    auto percent_compressed = ((double)(actual_compressed_size) / (double)(total_size)) * 100.0;
-    std::cout << "writing output (" << actual_compressed_size << " bytes, " << percent_compressed
-              << "%)...\n";
-    auto* f = fopen(path_to_string(output_path).c_str(), "wb");
+              << "\t# strings = " << header.num_strings << "\n"
+              << "\t# textures = " << header.num_textures << "\n"
+              << "\t# materials = " << header.num_materials << "\n"
+              << "\t# meshes = " << header.num_meshes << "\n"
+              << "\t# objects = " << header.num_objects << "\n"
+              << "\t# groups = " << header.num_groups << "\n"
+              << "\t# environments = " << header.num_environments << "\n";
+
+    std::cout << "writing output...\n";
+    // closed on the way out if anything below throws
+    std::unique_ptr<FILE, decltype(&fclose)> file{
+        fopen(path_to_string(output_path).c_str(), "wb"), fclose
+    };
+    FILE* f = file.get();
     if(f == nullptr) {
         std::cout << "could not create output file " << output_path << "\n";
         throw std::runtime_error("could not create output file");
     }
-    auto bytes_written = fwrite(compressed_buffer, 1, actual_compressed_size, f);
-    std::cout << "wrote " << bytes_written << " bytes " << ferror(f) << "\n";
-    assert(bytes_written == actual_compressed_size);
-    free(compressed_buffer);
-    fclose(f);
+
+    // assign each section its range of frames
+    std::vector<asset_bundle_format::section_header> sections;
+    sections.reserve(gpu_sections.size() + 1);
+    sections.emplace_back(asset_bundle_format::section_header{
+        .type = asset_bundle_format::section_type::cpu, .uncompressed_size = total_size
+    });
+    // GPU sections follow the CPU section in the same order as in gpu_sections
+    sections.insert(sections.end(), gpu_sections.begin(), gpu_sections.end());
+    for(auto& section : sections)
+        section.codec = opts.codecs[(size_t)section.type];
+    const size_t frame_size = opts.frame_size;
+    size_t       num_frames = 0;
+    for(auto& section : sections) {
+        section.first_frame = num_frames;
+        section.num_frames  = (section.uncompressed_size + frame_size - 1) / frame_size;
+        num_frames += section.num_frames;
+    }
+
+    // reserve space for the frame index, which is written last once the compressed size of each
+    // frame is known
+    std::vector<asset_bundle_format::frame_header> frames(num_frames);
+
+    asset_bundle_format::file_header fh{
+        .magic         = asset_bundle_format::MAGIC,
+        .version       = asset_bundle_format::VERSION,
+        .num_sections  = sections.size(),
+        .num_frames    = num_frames,
+        .frame_size    = frame_size,
+        .dictionary_id = dictionary_id
+    };
+    fwrite(&fh, sizeof(fh), 1, f);
+    fwrite(sections.data(), sizeof(asset_bundle_format::section_header), sections.size(), f);
+    // the frame index comes right after the header and section table, so its offset is small
+    // enough for fseek
+    long frame_index_offset
+        = (long)(sizeof(fh) + sizeof(asset_bundle_format::section_header) * sections.size());
+    fwrite(frames.data(), sizeof(asset_bundle_format::frame_header), frames.size(), f);
+
+    // compress each section and write it to the file
+    std::cout << "compressing bundle in " << num_frames << " frames...\n";
+    auto start_time = std::chrono::steady_clock::now();
+    // data that belongs to the bundle itself outlives the compressor, so it is not freed here
+    auto borrowed = [](const void* data) {
+        return std::shared_ptr<const byte>((const byte*)data, [](const byte*) {});
+    };
+    auto owned = [](byte* data) { return std::shared_ptr<const byte>(data, free); };
+    frame_compressor compressor{
+        opts,
+        dictionary,
+        f,
+        frame_index_offset + sizeof(asset_bundle_format::frame_header) * frames.size(),
+        frames
+    };
+
+    // the CPU section is compressed as it is written, so it is never in memory all at once
+    section_writer cpu_section{compressor, sections[0]};
+    cpu_section.write(header);
+    write_strings(cpu_section, header);
+    write_textures(cpu_section, header);
+    write_environments(cpu_section, header);
+    write_materials(cpu_section, header);
+    write_meshes(cpu_section, header);
+    write_objects(cpu_section, header);
+    write_groups(cpu_section, header);
+    write_name_tables(cpu_section, header);
+    cpu_section.finish();
+
+    // textures still on the GPU are needed from here on
+    tex_proc->finish_textures();
+
+    auto texture = textures.begin();
+    for(size_t i = 1; i < sections.size(); ++i) {
+        auto& section = sections[i];
+        switch(section.type) {
+            case asset_bundle_format::section_type::texture: {
+                const auto& info = texture->second;
+                store_texture_in_cache(info, info.data);
+                compressor.compress_section(section, borrowed(info.data));
+                ++texture;
+            } break;
+            case asset_bundle_format::section_type::environment: {
+                const auto& info = environments[section.index];
+                // check to see if this environment was processed on the GPU
+                if(info.data == nullptr) {
+                    byte* data = (byte*)malloc(section.uncompressed_size);
+                    tex_proc->recieve_processed_environment(section.index, data);
+                    store_environment_in_cache(info, data);
+                    compressor.compress_section(section, owned(data));
+                } else {
+                    store_environment_in_cache(info, info.data);
+                    compressor.compress_section(section, borrowed(info.data));
+                }
+            } break;
+            case asset_bundle_format::section_type::vertices:
+                if(opts.quantize_vertices)
+                    compressor.compress_section(section, borrowed(quantized_vertices.data()));
+                else
+                    compressor.compress_section(section, borrowed(vertices.data()));
+                break;
+            case asset_bundle_format::section_type::indices:
+                if(section.index == sizeof(short_index_type))
+                    compressor.compress_section(section, borrowed(short_indices.data()));
+                else
+                    compressor.compress_section(section, borrowed(indices.data()));
+                break;
+            default: assert(false);
+        }
+    }
+    compressor.finish();
+
+    uint64_t compressed_size = compressor.end_offset();
+    fseek(f, frame_index_offset, SEEK_SET);
+    fwrite(frames.data(), sizeof(asset_bundle_format::frame_header), frames.size(), f);
+    if(ferror(f) != 0 || fclose(file.release()) != 0)
+        throw std::runtime_error("failed to write output file");
+    double seconds
+        = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    size_t uncompressed_size = 0;
+    for(const auto& section : sections)
+        uncompressed_size += section.uncompressed_size;
+    std::cout << "wrote " << compressed_size << " bytes, compression ratio "
+              << (double)uncompressed_size / (double)compressed_size << ", "
+              << (double)uncompressed_size / (1024.0 * 1024.0) / std::max(seconds, 1e-9)
+              << " MiB/s\n";
     std::cout << "finished!\n";
 }
 
-void output_bundle::copy_strings(byte*& header_ptr, byte*& data_ptr, byte* top) const {
-    for(const auto& s : strings) {
-        *((asset_bundle_format::string_header*)header_ptr) = asset_bundle_format::string_header{
-            .id = s.first, .offset = (size_t)(data_ptr - top), .len = s.second.size()
-        };
-        header_ptr += sizeof(asset_bundle_format::string_header);
-        memcpy(data_ptr, s.second.data(), s.second.size());
-        data_ptr += s.second.size();
+void output_bundle::write_strings(section_writer& out, const asset_bundle_format::header& h) const {
+    out.pad_to(h.strings_offset);
+    // string ids are handed out sequentially starting at 1, so the map is already in id order
+    size_t data_offset
+        = h.strings_offset + sizeof(asset_bundle_format::string_header) * strings.size();
+    for(const auto& [id, s] : strings) {
+        out.write(asset_bundle_format::string_header{
+            .offset = (uint32_t)data_offset, .len = (uint32_t)s.size()
+        });
+        data_offset += s.size();
     }
+    for(const auto& [id, s] : strings)
+        out.write(s.data(), s.size());
 }
 
-void output_bundle::copy_textures(byte*& header_ptr, byte*& data_ptr, byte* top) const {
+void output_bundle::write_textures(section_writer& out, const asset_bundle_format::header& h)
+    const {
+    out.pad_to(h.textures_offset);
+    // texture sections come directly after the CPU section and are in the same order as textures
+    uint32_t section = 1;
     for(const auto& t : textures) {
-        *((asset_bundle_format::texture_header*)header_ptr) = asset_bundle_format::texture_header{
-            .id     = t.first,
-            .name   = t.second.name,
-            .img    = t.second.img.as_image(),
-            .offset = (size_t)(data_ptr - top)
-        };
-        header_ptr += sizeof(asset_bundle_format::texture_header);
-        // check to see if this texture was processed on the GPU
-        if(t.second.data == nullptr)
-            tex_proc->recieve_processed_texture(t.first, data_ptr);
-        else
-            memcpy(data_ptr, t.second.data, t.second.len);
-        data_ptr += t.second.len;
+        out.write(asset_bundle_format::texture_header{
+            .id      = t.first,
+            .name    = t.second.name,
+            .img     = t.second.img.as_image(),
+            .section = section++
+        });
     }
 }
 
-void output_bundle::copy_environments(byte*& header_ptr, byte*& data_ptr, byte* top) const {
+void output_bundle::write_environments(
+    section_writer& out, const asset_bundle_format::header& h
+) const {
+    out.pad_to(h.environments_offset);
+    // environment sections come directly after the texture sections
+    uint32_t section = 1 + (uint32_t)textures.size();
     for(const auto& e : environments) {
-        *((asset_bundle_format::environment_header*)header_ptr)
-            = asset_bundle_format::environment_header{
-                .name                      = e.name,
-                .skybox                    = e.skybox.as_image(),
-                .skybox_offset             = (size_t)(data_ptr - top),
-                .diffuse_irradiance        = e.diffuse_irradiance.as_image(),
-                .diffuse_irradiance_offset = (size_t)(data_ptr - top) + e.diffuse_irradiance_offset,
-            };
-        header_ptr += sizeof(asset_bundle_format::environment_header);
-        tex_proc->recieve_processed_environment(e.name, data_ptr);
-        data_ptr += e.len;
+        asset_bundle_format::environment_header eh{
+            .name = e.name, .skybox = e.skybox.as_image(), .section = section++
+        };
+        std::copy(
+            e.diffuse_irradiance_sh.begin(),
+            e.diffuse_irradiance_sh.end(),
+            eh.diffuse_irradiance_sh
+        );
+        out.write(eh);
+    }
+}
+
+// build a perfect hash table over the distinct names in entries, which are (name, index) pairs
+output_bundle::name_table_data output_bundle::build_name_table(
+    const std::vector<asset_bundle_format::name_slot>& entries,
+    const std::map<string_id, std::string>&            strings
+) {
+    name_table_data table;
+    if(entries.empty()) return table;
+
+    // strings are interned, so duplicate names have the same id. the first item with a name wins
+    std::vector<asset_bundle_format::name_slot> names;
+    std::unordered_set<string_id>               seen;
+    for(const auto& e : entries)
+        if(seen.insert(e.name).second) names.emplace_back(e);
+    std::vector<uint64_t> hashes;
+    hashes.reserve(names.size());
+    for(const auto& n : names)
+        hashes.emplace_back(asset_bundle_format::hash_name(strings.at(n.name)));
+
+    // a few names per bucket and some spare slots keep the seed search short
+    size_t num_buckets = (names.size() + 3) / 4;
+    size_t num_slots   = names.size() + names.size() / 4 + 1;
+    std::vector<std::vector<size_t>> buckets(num_buckets);
+    for(size_t i = 0; i < names.size(); ++i)
+        buckets[hashes[i] % num_buckets].emplace_back(i);
+
+    // place the biggest buckets first, while there are still lots of free slots
+    std::vector<size_t> order(num_buckets);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    table.seeds.resize(num_buckets, 0);
+    table.slots.resize(num_slots, asset_bundle_format::name_slot{INVALID_STRING, 0});
+    std::vector<size_t> bucket_slots;
+    for(size_t b : order) {
+        if(buckets[b].empty()) break;
+        for(uint32_t seed = 0;; ++seed) {
+            if(seed == std::numeric_limits<uint32_t>::max())
+                throw std::runtime_error("failed to build bundle name table");
+            bucket_slots.clear();
+            bool fits = true;
+            for(size_t i : buckets[b]) {
+                size_t slot = asset_bundle_format::name_slot_hash(hashes[i], seed) % num_slots;
+                if(table.slots[slot].name != INVALID_STRING
+                   || std::find(bucket_slots.begin(), bucket_slots.end(), slot)
+                          != bucket_slots.end()) {
+                    fits = false;
+                    break;
+                }
+                bucket_slots.emplace_back(slot);
+            }
+            if(!fits) continue;
+            table.seeds[b] = seed;
+            for(size_t j = 0; j < bucket_slots.size(); ++j)
+                table.slots[bucket_slots[j]] = names[buckets[b][j]];
+            break;
+        }
+    }
+    return table;
+}
+
+void output_bundle::build_name_tables() {
+    std::vector<std::vector<asset_bundle_format::name_slot>> entries(
+        asset_bundle_format::NUM_NAME_TABLES
+    );
+    for(uint32_t i = 0; i < groups.size(); ++i)
+        entries[asset_bundle_format::group_names].emplace_back(groups[i].name, i);
+    for(uint32_t i = 0; i < objects.size(); ++i)
+        entries[asset_bundle_format::object_names].emplace_back(objects[i].name, i);
+    for(uint32_t i = 0; i < materials.size(); ++i)
+        entries[asset_bundle_format::material_names].emplace_back(materials[i].name, i);
+    for(const auto& [id, t] : textures)
+        entries[asset_bundle_format::texture_names].emplace_back(t.name, id);
+
+    name_tables.clear();
+    for(const auto& e : entries)
+        name_tables.emplace_back(build_name_table(e, strings));
+}
+
+void output_bundle::write_name_tables(section_writer& out, const asset_bundle_format::header& h)
+    const {
+    for(size_t i = 0; i < name_tables.size(); ++i) {
+        const auto& t = name_tables[i];
+        out.pad_to(h.name_tables[i].seeds_offset);
+        out.write(t.seeds.data(), t.seeds.size() * sizeof(uint32_t));
+        out.pad_to(h.name_tables[i].slots_offset);
+        out.write(t.slots.data(), t.slots.size() * sizeof(asset_bundle_format::name_slot));
     }
 }
 
-void output_bundle::copy_materials(byte*& header_ptr) const {
-    size_t s = materials.size() * sizeof(asset_bundle_format::material_header);
+void output_bundle::write_materials(section_writer& out, const asset_bundle_format::header& h)
+    const {
+    out.pad_to(h.materials_offset);
     // !!! Assumes that material_header === material_info
-    memcpy(header_ptr, materials.data(), s);
-    header_ptr += s;
+    out.write(materials.data(), materials.size() * sizeof(asset_bundle_format::material_header));
 }
 
-void output_bundle::copy_meshes(byte*& header_ptr) const {
-    size_t s = meshes.size() * sizeof(asset_bundle_format::mesh_header);
+void output_bundle::write_meshes(section_writer& out, const asset_bundle_format::header& h) const {
+    out.pad_to(h.meshes_offset);
     // !!! Assumes that mesh_header === mesh_info
-    memcpy(header_ptr, meshes.data(), s);
-    header_ptr += s;
+    out.write(meshes.data(), meshes.size() * sizeof(asset_bundle_format::mesh_header));
 }
 
-void output_bundle::copy_objects(byte*& header_ptr, byte*& data_ptr, byte* top) const {
+void output_bundle::write_objects(section_writer& out, const asset_bundle_format::header& h) const {
+    // each array is written in full before the next one starts
+    out.pad_to(h.object_names_offset);
+    for(const auto& o : objects)
+        out.write(o.name);
+    out.pad_to(h.object_transforms_offset);
+    for(const auto& o : objects)
+        out.write(asset_bundle_format::affine_transform(o.transform));
+    out.pad_to(h.object_bounds_offset);
+    for(const auto& o : objects)
+        out.write(o.bounds);
+    out.pad_to(h.object_meshes_offset);
+    uint32_t next_index = 0;
     for(const auto& o : objects) {
-        auto* h = ((asset_bundle_format::object_header*)header_ptr);
-        *h      = asset_bundle_format::object_header{
-                 .name             = o.name,
-                 .num_meshes       = (uint32_t)o.mesh_indices.size(),
-                 .offset           = (size_t)(data_ptr - top),
-                 .transform_matrix = o.transform,
-                 .bounds           = o.bounds
-        };
-        header_ptr += sizeof(asset_bundle_format::object_header);
-        memcpy(data_ptr, o.mesh_indices.data(), o.mesh_indices.size() * sizeof(uint32_t));
-        data_ptr += o.mesh_indices.size() * sizeof(uint32_t);
+        out.write(asset_bundle_format::index_range{next_index, (uint32_t)o.mesh_indices.size()});
+        next_index += o.mesh_indices.size();
     }
+    out.pad_to(h.object_mesh_indices_offset);
+    for(const auto& o : objects)
+        out.write(o.mesh_indices.data(), o.mesh_indices.size() * sizeof(uint32_t));
 }
 
-void output_bundle::copy_groups(byte*& header_ptr, byte*& data_ptr, byte* top) const {
-    for(const auto& o : groups) {
-        auto* h = ((asset_bundle_format::group_header*)header_ptr);
-        *h      = asset_bundle_format::group_header{
-                 .name        = o.name,
-                 .num_objects = (uint32_t)o.objects.size(),
-                 .offset      = (size_t)(data_ptr - top),
-                 .bounds      = o.bounds
-        };
-        header_ptr += sizeof(asset_bundle_format::group_header);
-        memcpy(data_ptr, o.objects.data(), o.objects.size() * sizeof(object_id));
-        data_ptr += o.objects.size() * sizeof(object_id);
+void output_bundle::write_groups(section_writer& out, const asset_bundle_format::header& h) const {
+    out.pad_to(h.group_names_offset);
+    for(const auto& g : groups)
+        out.write(g.name);
+    out.pad_to(h.group_bounds_offset);
+    for(const auto& g : groups)
+        out.write(g.bounds);
+    out.pad_to(h.group_objects_offset);
+    uint32_t next_index = 0;
+    for(const auto& g : groups) {
+        out.write(asset_bundle_format::index_range{next_index, (uint32_t)g.objects.size()});
+        next_index += g.objects.size();
     }
+    out.pad_to(h.group_object_indices_offset);
+    for(const auto& g : groups)
+        out.write(g.objects.data(), g.objects.size() * sizeof(object_id));
+}
+
+void output_bundle::store_texture_in_cache(const texture_info& info, const void* data) const {
+    if(!info.cache_entry.has_value()) return;
+    const auto&           entry = *info.cache_entry;
+    cached_texture_header header{
+        .width        = entry.width,
+        .height       = entry.height,
+        .channels     = entry.channels,
+        .texel_digest = entry.texel_digest,
+        .img          = info.img,
+        .len          = info.len
+    };
+    cache->store(entry.key, &header, sizeof(header), data, info.len);
+}
+
+void output_bundle::store_environment_in_cache(const environment_info& info, const void* data)
+    const {
+    if(!info.cache_key.has_value()) return;
+    cached_environment_header header{
+        .skybox                = info.skybox,
+        .diffuse_irradiance_sh = info.diffuse_irradiance_sh,
+        .len                   = info.len
+    };
+    cache->store(*info.cache_key, &header, sizeof(header), data, info.len);
 }
 
 output_bundle::~output_bundle() {
     for(const auto& [id, ifo] : textures)
         free(ifo.data);
+    for(const auto& e : environments)
+        free(e.data);
 }
@@ -0,0 +1,44 @@
+#include "asset-bundler/parallel.h"
+
+worker_pool::worker_pool(unsigned num_threads, size_t max_queued) {
+    if(num_threads == 0) num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    this->max_queued = max_queued != 0 ? max_queued : num_threads;
+    threads.reserve(num_threads);
+    for(unsigned i = 0; i < num_threads; ++i)
+        threads.emplace_back([this] { run(); });
+}
+
+worker_pool::~worker_pool() {
+    {
+        std::lock_guard lock{mutex};
+        stopping = true;
+    }
+    queue_not_empty.notify_all();
+    for(auto& t : threads)
+        t.join();
+}
+
+void worker_pool::push(std::function<void()> job) {
+    {
+        std::unique_lock lock{mutex};
+        queue_not_full.wait(lock, [&] { return queue.size() < max_queued; });
+        queue.emplace_back(std::move(job));
+    }
+    queue_not_empty.notify_one();
+}
+
+void worker_pool::run() {
+    while(true) {
+        std::function<void()> job;
+        {
+            std::unique_lock lock{mutex};
+            queue_not_empty.wait(lock, [&] { return stopping || !queue.empty(); });
+            if(queue.empty()) return;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        queue_not_full.notify_one();
+        // jobs are packaged tasks, which keep their own exceptions
+        job();
+    }
+}
@@ -0,0 +1,148 @@
+#include "asset-bundler/texture_compression.h"
+#include "egg/renderer/memory.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <stb_dxt.h>
+#include <vulkan/vulkan_format_traits.hpp>
+extern "C" {
+#include <bc7enc.h>
+}
+
+vk::Format block_compressed_format(
+    texture_usage usage, vk::Format format, uint32_t width, uint32_t height, const stbi_uc* data
+) {
+    switch(usage) {
+        case texture_usage::normal_map: return vk::Format::eBc5UnormBlock;
+        // BC1 shares one pair of endpoint colors between all three channels, which bleeds them
+        // into each other, while BC7 can keep them apart
+        case texture_usage::occlusion_roughness_metallic: return vk::Format::eBc7UnormBlock;
+        case texture_usage::color:
+            if(vk::blockSize(format) == 4) {
+                size_t num_texels = (size_t)width * height;
+                for(size_t i = 0; i < num_texels; ++i)
+                    if(data[i * 4 + 3] != 0xff) return vk::Format::eBc7UnormBlock;
+            }
+            return vk::Format::eBc1RgbUnormBlock;
+    }
+    throw std::runtime_error("unknown texture usage");
+}
+
+// a run of block rows in one mip level
+struct block_rows {
+    const uint8_t* src;
+    uint8_t*       dest;
+    uint32_t       width, height, first_row, num_rows;
+};
+
+// read the 4x4 block at (bx, by) as RGBA, repeating the edge texels of levels that are not a
+// multiple of 4 in size and filling in missing channels the same way a sampler would
+void gather_block(
+    const uint8_t* level,
+    size_t         nchannels,
+    uint32_t       width,
+    uint32_t       height,
+    uint32_t       bx,
+    uint32_t       by,
+    uint8_t*       rgba
+) {
+    for(uint32_t y = 0; y < 4; ++y) {
+        for(uint32_t x = 0; x < 4; ++x) {
+            size_t sx = std::min(bx * 4 + x, width - 1), sy = std::min(by * 4 + y, height - 1);
+            const uint8_t* texel = level + (sy * width + sx) * nchannels;
+            uint8_t*       out   = rgba + (y * 4 + x) * 4;
+            out[0]               = texel[0];
+            out[1]               = nchannels > 1 ? texel[1] : 0;
+            out[2]               = nchannels > 2 ? texel[2] : 0;
+            out[3]               = nchannels > 3 ? texel[3] : 0xff;
+        }
+    }
+}
+
+// colors are compared perceptually, but textures that hold data in each channel need every
+// channel kept equally well
+const bc7enc_compress_block_params& bc7_params(texture_usage usage) {
+    static const auto params = [] {
+        // the encoder's tables are built once, before any block is compressed
+        bc7enc_compress_block_init();
+        std::array<bc7enc_compress_block_params, 2> p;
+        bc7enc_compress_block_params_init(&p[0]);
+        bc7enc_compress_block_params_init(&p[1]);
+        bc7enc_compress_block_params_init_linear_weights(&p[1]);
+        return p;
+    }();
+    return params[usage == texture_usage::color ? 0 : 1];
+}
+
+void compress_block(
+    const uint8_t* rgba, vk::Format format, const bc7enc_compress_block_params& bc7, uint8_t* dest
+) {
+    switch(format) {
+        case vk::Format::eBc1RgbUnormBlock:
+            stb_compress_dxt_block(dest, rgba, 0, STB_DXT_HIGHQUAL);
+            break;
+        case vk::Format::eBc7UnormBlock: bc7enc_compress_block(dest, rgba, &bc7); break;
+        case vk::Format::eBc5UnormBlock: {
+            uint8_t rg[32];
+            for(size_t i = 0; i < 16; ++i) {
+                rg[i * 2 + 0] = rgba[i * 4 + 0];
+                rg[i * 2 + 1] = rgba[i * 4 + 1];
+            }
+            stb_compress_bc5_block(dest, rg);
+        } break;
+        default: assert(false);
+    }
+}
+
+void block_compress_mip_chain(
+    const uint8_t* src,
+    vk::Format     src_format,
+    uint32_t       width,
+    uint32_t       height,
+    uint32_t       mip_levels,
+    vk::Format     dest_format,
+    texture_usage  usage,
+    uint8_t*       dest,
+    worker_pool&   workers
+) {
+    switch(dest_format) {
+        case vk::Format::eBc1RgbUnormBlock:
+        case vk::Format::eBc5UnormBlock:
+        case vk::Format::eBc7UnormBlock: break;
+        default:
+            throw std::runtime_error(
+                "unsupported block compressed format " + vk::to_string(dest_format)
+            );
+    }
+    size_t      nchannels = vk::blockSize(src_format), block_size = vk::blockSize(dest_format);
+    const auto& bc7       = bc7_params(usage);
+
+    // cut every level into runs of 16 block rows, so that the large levels are shared between
+    // threads and the many small ones do not each cost a task
+    const uint32_t          rows_per_task = 16;
+    std::vector<block_rows> tasks;
+    for(uint32_t level = 0; level < mip_levels; ++level) {
+        uint32_t num_rows = (height + 3) / 4;
+        for(uint32_t row = 0; row < num_rows; row += rows_per_task)
+            tasks.emplace_back(block_rows{
+                src, dest, width, height, row, std::min(rows_per_task, num_rows - row)
+            });
+        src += image_level_size_in_bytes(width, height, src_format);
+        dest += image_level_size_in_bytes(width, height, dest_format);
+        width  = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    parallel_for(tasks.size(), workers, [&](size_t i) {
+        uint8_t     rgba[16 * 4];
+        const auto& t          = tasks[i];
+        uint32_t    row_blocks = (t.width + 3) / 4;
+        for(uint32_t by = t.first_row; by < t.first_row + t.num_rows; ++by) {
+            for(uint32_t bx = 0; bx < row_blocks; ++bx) {
+                gather_block(t.src, nchannels, t.width, t.height, bx, by, rgba);
+                uint8_t* block = t.dest + (by * row_blocks + bx) * block_size;
+                compress_block(rgba, dest_format, bc7, block);
+            }
+        }
+    });
+}
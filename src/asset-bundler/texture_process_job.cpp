@@ -2,32 +2,36 @@
 #include <vulkan/vulkan_format_traits.hpp>
 
 texture_process_job::texture_process_job(
-    vk::Device                            dev,
-    vk::CommandPool                       cmd_pool,
     const std::shared_ptr<gpu_allocator>& alloc,
-    texture_info*                         info
+    texture_info*                         info,
+    vk::Format                            format,
+    gpu_buffer&                           staging,
+    size_t                                staging_offset
 )
-    : process_job(dev, cmd_pool),
-      image_info{info->img.vulkan_create_info(
-          vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst
-      )} {
+    : info(info),
+      image_info{info->img
+                     .vulkan_create_info(
+                         vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst
+                     )
+                     .setFormat(format)},
+      output_format(info->img.format), staging_offset(staging_offset) {
     total_output_size = linear_image_size_in_bytes(image_info);
 
     img = std::make_unique<gpu_image>(alloc, image_info);
-    init_staging_buffer(alloc, total_output_size);
 
     // copy original data into staging buffer
     memcpy(
-        staging->cpu_mapped(),
+        (uint8_t*)staging.cpu_mapped() + staging_offset,
         info->data,
-        info->img.width * info->img.height * vk::blockSize(info->img.format)
+        info->img.width * info->img.height * vk::blockSize(format)
     );
+}
 
-    cmd_buffer->begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-
+void texture_process_job::build_cmd_buffer(vk::CommandBuffer cmd_buffer, vk::Buffer staging)
+    const {
     // transition the first mip level to transfer destination to prepare to recieve staging buffer
     // data
-    cmd_buffer->pipelineBarrier(
+    cmd_buffer.pipelineBarrier(
         vk::PipelineStageFlagBits::eTransfer,
         vk::PipelineStageFlagBits::eTransfer,
         {
@@ -47,12 +51,12 @@ texture_process_job::texture_process_job(
     );
 
     // copy original image data from staging buffer to first mip level
-    cmd_buffer->copyBufferToImage(
-        staging->get(),
+    cmd_buffer.copyBufferToImage(
+        staging,
         img->get(),
         vk::ImageLayout::eTransferDstOptimal,
         vk::BufferImageCopy{
-            0,
+            staging_offset,
             0,
             0,
             vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1},
@@ -60,9 +64,12 @@ texture_process_job::texture_process_job(
             vk::Extent3D{info->img.width, info->img.height, 1}
     }
     );
+
+    generate_mipmaps(cmd_buffer, staging);
 }
 
-void texture_process_job::generate_mipmaps() {
+void texture_process_job::generate_mipmaps(vk::CommandBuffer cmd_buffer, vk::Buffer staging)
+    const {
     // create structures for submitting commands
     vk::ImageBlit blit_info{
         vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1},
@@ -98,7 +105,7 @@ void texture_process_job::generate_mipmaps() {
 
     // initial transition: transition the base mip level to source layout and the first new mip
     // level to destination layout
-    cmd_buffer->pipelineBarrier(
+    cmd_buffer.pipelineBarrier(
         vk::PipelineStageFlagBits::eTransfer,
         vk::PipelineStageFlagBits::eTransfer,
         {},
@@ -109,7 +116,7 @@ void texture_process_job::generate_mipmaps() {
 
     // generate each mip level by copying from the last one
     for(uint32_t i = 1; i < image_info.mipLevels; ++i) {
-        cmd_buffer->blitImage(
+        cmd_buffer.blitImage(
             img->get(),
             vk::ImageLayout::eTransferSrcOptimal,
             img->get(),
@@ -134,7 +141,7 @@ void texture_process_job::generate_mipmaps() {
             // can write to it in the next iteration
             barrierUninitToDst.subresourceRange.setBaseMipLevel(blit_info.dstSubresource.mipLevel);
 
-            cmd_buffer->pipelineBarrier(
+            cmd_buffer.pipelineBarrier(
                 vk::PipelineStageFlagBits::eTransfer,
                 vk::PipelineStageFlagBits::eTransfer,
                 {},
@@ -147,7 +154,7 @@ void texture_process_job::generate_mipmaps() {
 
     // transition the last mip level from transfer destination to transfer source
     barrierDstToSrc.subresourceRange.setBaseMipLevel(image_info.mipLevels - 1);
-    cmd_buffer->pipelineBarrier(
+    cmd_buffer.pipelineBarrier(
         vk::PipelineStageFlagBits::eTransfer,
         vk::PipelineStageFlagBits::eTransfer,
         {},
@@ -156,7 +163,7 @@ void texture_process_job::generate_mipmaps() {
         {barrierDstToSrc}
     );
 
-    size_t offset  = 0;
+    size_t offset  = staging_offset;
     auto   regions = copy_regions_for_linear_image2d(
         image_info.extent.width,
         image_info.extent.height,
@@ -165,7 +172,21 @@ void texture_process_job::generate_mipmaps() {
         image_info.format,
         offset
     );
-    cmd_buffer->copyImageToBuffer(
-        img->get(), vk::ImageLayout::eTransferSrcOptimal, staging->get(), regions
+    cmd_buffer.copyImageToBuffer(
+        img->get(), vk::ImageLayout::eTransferSrcOptimal, staging, regions
     );
 }
+
+texture_batch::texture_batch(
+    vk::Device                            dev,
+    vk::CommandPool                       cmd_pool,
+    const std::shared_ptr<gpu_allocator>& alloc,
+    size_t                                capacity
+)
+    : staging(create_staging_buffer(alloc, capacity)), capacity(capacity), size(0) {
+    cmd_buffer = std::move(dev.allocateCommandBuffersUnique(
+        vk::CommandBufferAllocateInfo{cmd_pool, vk::CommandBufferLevel::ePrimary, 1}
+    )[0]);
+
+    fence = dev.createFenceUnique(vk::FenceCreateInfo{});
+}
@@ -1,5 +1,9 @@
 #include "asset-bundler/texture_processor.h"
+#include "asset-bundler/environment_processing.h"
+#include "asset-bundler/mip_generation.h"
+#include "asset-bundler/texture_compression.h"
 #include "asset-bundler/texture_process_jobs.h"
+#include <algorithm>
 #include <error.h>
 #include <iostream>
 #include <vulkan/vulkan_format_traits.hpp>
@@ -33,11 +37,38 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
     return VK_FALSE;
 }
 
+// textures are recorded into batches with this much staging memory, unless one is bigger
+const size_t texture_batch_capacity = 32 * 1024 * 1024;
+// submitting textures waits for earlier batches to finish once this much staging memory is in use
+const size_t max_texture_bytes_in_flight = 256 * 1024 * 1024;
+// offsets into a batch's staging buffer must be aligned for every texel size
+const size_t staging_alignment = 16;
+
 const vk::ApplicationInfo APP_INFO = vk::ApplicationInfo{
     "asset-bundler", VK_MAKE_VERSION(0, 0, 0), "egg", VK_MAKE_VERSION(0, 0, 0), VK_API_VERSION_1_3
 };
 
-texture_processor::texture_processor(options opts) : env_res(nullptr), opts(opts) {
+texture_processor::texture_processor(options opts)
+    : env_res(nullptr), opts(opts), workers(opts.import_workers) {
+    // machines without a GPU, like build servers, can still process textures on the CPU
+    bool have_device = false;
+    try {
+        have_device = init_device();
+    } catch(vk::SystemError& e) {
+        std::cout << "failed to initialize Vulkan: " << e.what() << "\n";
+    }
+    if(!have_device) {
+        cmd_pool.reset();
+        allocator.reset();
+        device.reset();
+        instance.reset();
+        std::cout << "no suitable GPU found, processing textures and environments on the CPU\n";
+    } else if(!gpu_mips()) {
+        std::cout << "generating mip levels on the CPU\n";
+    }
+}
+
+bool texture_processor::init_device() {
     std::vector<const char*> extensions;
     // extensions.push_back("VK_KHR_portability_enumeration");
 #ifndef NDEBUG
@@ -65,10 +96,13 @@ texture_processor::texture_processor(options opts) : env_res(nullptr), opts(opts
     );
 #endif
 
+    // prefer a discrete GPU, but any device will do. CPU implementations like lavapipe are still
+    // faster than no device at all for environment processing
     auto physical_devices = instance->enumeratePhysicalDevices();
+    std::stable_partition(physical_devices.begin(), physical_devices.end(), [](auto pd) {
+        return pd.getProperties().deviceType == vk::PhysicalDeviceType::eDiscreteGpu;
+    });
     for(auto pd : physical_devices) {
-        if(pd.getProperties().deviceType != vk::PhysicalDeviceType::eDiscreteGpu) continue;
-
         auto qufams = pd.getQueueFamilyProperties();
         for(uint32_t i = 0; i < qufams.size(); ++i) {
             // TODO: right now we only support a single queue with graphcs and compute support
@@ -79,8 +113,9 @@ texture_processor::texture_processor(options opts) : env_res(nullptr), opts(opts
                 break;
             }
         }
+        if(phy_device) break;
     }
-    if(!phy_device) throw std::runtime_error("failed to find suitable physical device");
+    if(!phy_device) return false;
     auto props = phy_device.getProperties();
     std::cout << "using physical device " << props.deviceName << " ("
               << vk::to_string(props.deviceType) << ")\n";
@@ -120,19 +155,39 @@ texture_processor::texture_processor(options opts) : env_res(nullptr), opts(opts
     cmd_pool = device->createCommandPoolUnique(vk::CommandPoolCreateInfo{
         vk::CommandPoolCreateFlagBits::eResetCommandBuffer, graphics_queue_family_index
     });
+    return true;
+}
+
+bool texture_processor::gpu_mips() const {
+    return device && !opts.cpu_mips && opts.mips_filter == mip_filter::box;
 }
 
 texture_processor::~texture_processor() {
-    assert(jobs.empty());
+    // batches are normally finished by finish_textures, but if writing the bundle threw some may
+    // still be in flight, and the GPU has to be done with them before they are destroyed. their
+    // results are dropped, since the textures they were for may already be gone
+    if(device) {
+        try {
+            device->waitIdle();
+        } catch(vk::SystemError& e) {
+            std::cout << "failed to wait for texture processing to finish: " << e.what() << "\n";
+        }
+    }
+    open_batch.reset();
+    submitted_batches.clear();
+    free_batches.clear();
+    env_jobs.clear();
     env_res.reset();
     allocator.reset();
     cmd_pool.reset();
     device.reset();
-    instance->destroyDebugReportCallbackEXT(
-        debug_report_callback,
-        nullptr,
-        vk::DispatchLoaderDynamic(instance.get(), vkGetInstanceProcAddr)
-    );
+    if(instance) {
+        instance->destroyDebugReportCallbackEXT(
+            debug_report_callback,
+            nullptr,
+            vk::DispatchLoaderDynamic(instance.get(), vkGetInstanceProcAddr)
+        );
+    }
     instance.reset();
 }
 
@@ -140,48 +195,188 @@ void texture_processor::submit_texture(texture_id id, texture_info* info) {
     info->img.mip_levels
         = (uint32_t)std::floor(std::log2(std::max(info->img.width, info->img.height))) + 1;
 
-    if(info->img.mip_levels == 1) {
-        // no reason to generate mip levels for this texture at all
-        info->len = info->img.width * vk::blockSize(info->img.format) * info->img.height;
+    // mip levels are generated in the uncompressed format, and block compressed on the CPU once
+    // they come back from the GPU
+    vk::Format uncompressed_format = info->img.format;
+    if(opts.compress_textures) {
+        info->img.format = block_compressed_format(
+            info->usage, uncompressed_format, info->img.width, info->img.height, info->data
+        );
+    }
+    info->len = linear_image_size_in_bytes(info->img.vulkan_create_info({}));
+
+    if(info->img.mip_levels == 1 || !gpu_mips()) {
+        // textures with a single level and textures with CPU generated levels are finished right
+        // away, leaving them in info->data
+        if(info->img.mip_levels > 1) {
+            auto uncompressed_info   = info->img;
+            uncompressed_info.format = uncompressed_format;
+            // the top level is already in place at the start of the chain
+            info->data = (stbi_uc*)realloc(
+                info->data, linear_image_size_in_bytes(uncompressed_info.vulkan_create_info({}))
+            );
+            generate_mip_chain(
+                info->data,
+                uncompressed_format,
+                info->img.width,
+                info->img.height,
+                info->img.mip_levels,
+                opts.mips_filter,
+                workers
+            );
+        }
+        if(info->img.format != uncompressed_format) {
+            auto* compressed = (stbi_uc*)malloc(info->len);
+            block_compress_mip_chain(
+                info->data,
+                uncompressed_format,
+                info->img.width,
+                info->img.height,
+                info->img.mip_levels,
+                info->img.format,
+                info->usage,
+                compressed,
+                workers
+            );
+            free(info->data);
+            info->data = compressed;
+        }
         return;
     }
 
-    texture_process_job s{device.get(), cmd_pool.get(), allocator, info};
+    auto uncompressed_info   = info->img;
+    uncompressed_info.format = uncompressed_format;
+
+    size_t size = linear_image_size_in_bytes(uncompressed_info.vulkan_create_info({}));
+    size += (staging_alignment - (size % staging_alignment)) % staging_alignment;
+
+    // wait for earlier textures to come back before taking more memory, so that the memory used
+    // stays bounded however many textures there are
+    while(bytes_in_flight + size > max_texture_bytes_in_flight
+          && (open_batch != nullptr || !submitted_batches.empty())) {
+        if(submitted_batches.empty()) submit_open_batch();
+        finish_oldest_batch();
+    }
+    if(open_batch != nullptr && open_batch->size + size > open_batch->capacity)
+        submit_open_batch();
+    if(open_batch == nullptr) {
+        auto reuse = std::find_if(free_batches.begin(), free_batches.end(), [&](const auto& b) {
+            return b->capacity >= size;
+        });
+        if(reuse != free_batches.end()) {
+            open_batch = std::move(*reuse);
+            free_batches.erase(reuse);
+        } else {
+            open_batch = std::make_unique<texture_batch>(
+                device.get(), cmd_pool.get(), allocator, std::max(size, texture_batch_capacity)
+            );
+        }
+        open_batch->cmd_buffer->begin(
+            vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
+        );
+    }
+
+    auto& job = open_batch->jobs.emplace_back(
+        allocator, info, uncompressed_format, *open_batch->staging, open_batch->size
+    );
+    job.build_cmd_buffer(open_batch->cmd_buffer.get(), open_batch->staging->get());
+    open_batch->size += size;
+    bytes_in_flight += size;
 
     // free CPU image data and mark that this image has been copied to the GPU
     free(info->data);
     info->data = nullptr;
 
-    s.generate_mipmaps();
+    // collect any batches that are already done without waiting for them
+    while(!submitted_batches.empty()
+          && device->getFenceStatus(submitted_batches.front()->fence.get())
+                 == vk::Result::eSuccess)
+        finish_oldest_batch();
+}
 
-    s.submit(graphics_queue);
-    info->len = s.total_output_size;
-    jobs.emplace(id, std::move(s));
+void texture_processor::submit_open_batch() {
+    open_batch->cmd_buffer->end();
+    graphics_queue.submit(
+        vk::SubmitInfo{0, nullptr, nullptr, 1, &open_batch->cmd_buffer.get()},
+        open_batch->fence.get()
+    );
+    submitted_batches.emplace_back(std::move(open_batch));
 }
 
-void texture_processor::recieve_processed_texture(texture_id id, void* destination) {
-    auto job = std::move(jobs.extract(id).mapped());
-    // copy data out of staging buffer into destination
-    job.wait_for_completion((uint8_t*)destination);
-    // clean up resources used for this texture
+void texture_processor::finish_oldest_batch() {
+    auto batch = std::move(submitted_batches.front());
+    submitted_batches.pop_front();
+
+    auto err = device->waitForFences(batch->fence.get(), VK_TRUE, UINT64_MAX);
+    if(err != vk::Result::eSuccess)
+        throw vulkan_runtime_error("failed to run texture process batch", err);
+
+    // since the GPU already copied each image into the staging buffer in the right layout, the
+    // results only need to be copied out of GPU shared memory, block compressing them on the way
+    auto* staging = (uint8_t*)batch->staging->cpu_mapped();
+    for(const auto& job : batch->jobs) {
+        job.info->data = (stbi_uc*)malloc(job.info->len);
+        if(job.output_format == job.image_info.format) {
+            memcpy(job.info->data, staging + job.staging_offset, job.total_output_size);
+        } else {
+            block_compress_mip_chain(
+                staging + job.staging_offset,
+                job.image_info.format,
+                job.image_info.extent.width,
+                job.image_info.extent.height,
+                job.image_info.mipLevels,
+                job.output_format,
+                job.info->usage,
+                job.info->data,
+                workers
+            );
+        }
+    }
+
+    // clean up the images, and keep the rest of the batch for later textures
+    batch->jobs.clear();
+    bytes_in_flight -= batch->size;
+    batch->size = 0;
+    batch->cmd_buffer->reset();
+    device->resetFences(batch->fence.get());
+    free_batches.emplace_back(std::move(batch));
+}
+
+void texture_processor::finish_textures() {
+    if(open_batch != nullptr) submit_open_batch();
+    while(!submitted_batches.empty())
+        finish_oldest_batch();
 }
 
 environment_info texture_processor::submit_environment(
-    string_id name, uint32_t width, uint32_t height, int nchannels, float* data
+    size_t index, string_id name, uint32_t width, uint32_t height, int nchannels, float* data
 ) {
     environment_info info{
-        .name = name,
+        .name   = name,
         // TODO: these are fixed but should be based on some kind of quality level
-        .skybox             = image_info{2048, 2048, 1, 6, vk::Format::eR8G8B8A8Unorm     },
-        .diffuse_irradiance = image_info{128,  128,  1, 6, vk::Format::eR16G16B16A16Sfloat}
+        .skybox = image_info{2048, 2048, 1, 6, vk::Format::eR8G8B8A8Unorm}
     };
 
-    if(env_res == nullptr)
-        env_res = std::make_unique<environment_process_job_resources>(device.get());
-
     std::cout << "processing environment " << name << " " << width << "x" << height << " "
               << nchannels << "\n";
 
+    // diffuse irradiance is only 27 numbers, which are quicker to project on the CPU than to read
+    // back from the GPU
+    equirect_map src{data, width, height, nchannels};
+    info.diffuse_irradiance_sh = diffuse_irradiance_sh(src, workers);
+
+    if(!device || opts.cpu_environments) {
+        // processed right away, leaving the result in info.data laid out like the GPU job's
+        info.len  = linear_image_size_in_bytes(info.skybox.vulkan_create_info({}));
+        info.data = (stbi_uc*)malloc(info.len);
+        process_environment_on_cpu(info, src, info.data, workers);
+        free(data);
+        return info;
+    }
+
+    if(env_res == nullptr)
+        env_res = std::make_unique<environment_process_job_resources>(device.get());
+
     environment_process_job s{
         device.get(),
         cmd_pool.get(),
@@ -191,21 +386,26 @@ environment_info texture_processor::submit_environment(
         width,
         height,
         nchannels,
-        data,
-        opts.enable_ibl_precomputation
+        data
     };
 
     // free CPU source data
     free(data);
 
     s.submit(graphics_queue);
-    env_jobs.emplace(name, std::move(s));
+    if(!env_jobs.emplace(index, std::move(s)).second)
+        throw std::runtime_error("environment " + std::to_string(index) + " submitted twice");
 
     return info;
 }
 
-void texture_processor::recieve_processed_environment(string_id name, void* destination) {
-    auto job = std::move(env_jobs.extract(name).mapped());
+void texture_processor::recieve_processed_environment(size_t index, void* destination) {
+    auto node = env_jobs.extract(index);
+    if(node.empty())
+        throw std::runtime_error(
+            "environment " + std::to_string(index) + " was not processed on the GPU"
+        );
+    auto job = std::move(node.mapped());
     // copy data out of staging buffer into destination
     job.wait_for_completion((uint8_t*)destination);
     // clean up resources used for this texture
@@ -215,7 +415,7 @@ size_t linear_image_size_in_bytes(const vk::ImageCreateInfo& image_info) {
     size_t   total_size = 0;
     uint32_t w = image_info.extent.width, h = image_info.extent.height;
     for(auto mi = 0; mi < image_info.mipLevels; ++mi) {
-        total_size += w * h * vk::blockSize(image_info.format);
+        total_size += image_level_size_in_bytes(w, h, image_info.format);
         w = glm::max(w / 2, 1u);
         h = glm::max(h / 2, 1u);
     }
@@ -0,0 +1,265 @@
+#include "egg/bundle.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+
+/* bundle-bench:
+ *  measures how long it takes to load an asset bundle, without needing a GPU
+ *  for each run it measures:
+ *      - raw file read throughput
+ *      - opening the bundle and parsing the CPU section
+ *      - decompression throughput of the GPU data
+ *      - name lookups and object mesh iteration
+ *  cold runs evict the bundle from the OS page cache before each step (Linux only), warm runs
+ *  read it from memory
+ *  usage:
+ *      bundle-bench <bundle path> [-n <runs>] [-t <decompression threads>] [-d <dictionary>]
+ *          [--warm-only]
+ */
+
+using bench_clock = std::chrono::steady_clock;
+
+inline double ms_since(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+inline double mib_per_sec(size_t bytes, double ms) {
+    return (double)bytes / (1024.0 * 1024.0) / std::max(ms / 1000.0, 1e-9);
+}
+
+// evict a file from the OS page cache so the next read has to go to the disk
+bool drop_from_page_cache(const std::filesystem::path& location) {
+#if defined(_WIN32) || defined(__APPLE__)
+    return false;
+#else
+    int fd = open(location.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+enum metric_id {
+    file_read,
+    open_and_parse,
+    gpu_decompression,
+    group_lookup,
+    object_lookup,
+    mesh_iteration,
+    NUM_METRICS
+};
+
+const char* metric_names[NUM_METRICS] = {
+    "file read (MiB/s)",
+    "open + parse CPU section (ms)",
+    "GPU data decompression (MiB/s)",
+    "group_by_name (ns/lookup)",
+    "object_by_name (ns/lookup)",
+    "object_meshes (ns/object)",
+};
+
+// nearest-rank percentile
+double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+    return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+}
+
+void print_row(const std::string& name, const std::vector<double>& values) {
+    std::cout << std::left << std::setw(40) << name << std::right;
+    if(values.empty()) {
+        std::cout << "(not measured)\n";
+        return;
+    }
+    for(double p : {50.0, 90.0, 99.0})
+        std::cout << std::setw(12) << percentile(values, p);
+    std::cout << std::setw(12) << *std::min_element(values.begin(), values.end())
+              << std::setw(12) << *std::max_element(values.begin(), values.end()) << "\n";
+}
+
+class bench {
+    std::filesystem::path location;
+    bundle_load_options   opts;
+    bool                  cold = false;
+    std::vector<double>   cold_samples[NUM_METRICS], warm_samples[NUM_METRICS];
+
+    void drop_cache() const {
+        if(cold && !drop_from_page_cache(location))
+            throw std::runtime_error("could not evict bundle from the page cache");
+    }
+
+    void record(metric_id m, double value) {
+        (cold ? cold_samples : warm_samples)[m].emplace_back(value);
+    }
+
+    template<typename F>
+    static double time_lookups(const std::vector<std::string>& names, F lookup) {
+        if(names.empty()) return 0.0;
+        size_t repeats = std::max<size_t>(1, 100000 / names.size());
+        size_t found   = 0;
+        auto   start   = bench_clock::now();
+        for(size_t r = 0; r < repeats; ++r)
+            for(const auto& n : names)
+                found += lookup(n) ? 1 : 0;
+        double ms = ms_since(start);
+        if(found != repeats * names.size())
+            throw std::runtime_error("name lookup failed for a name that is in the bundle");
+        return ms * 1e6 / (repeats * names.size());
+    }
+
+    void run_once() {
+        drop_cache();
+        auto start = bench_clock::now();
+        {
+            mapped_file file{location};
+            file.prefetch(0, file.size());
+            record(file_read, mib_per_sec(file.size(), ms_since(start)));
+        }
+
+        drop_cache();
+        start = bench_clock::now();
+        asset_bundle bundle{location, opts};
+        record(open_and_parse, ms_since(start));
+
+        // the destination is faulted in first so that only decompression is measured
+        std::vector<uint8_t> gpu_data(bundle.gpu_data_size());
+        drop_cache();
+        start = bench_clock::now();
+        bundle.decompress_gpu_data(gpu_data.data(), gpu_data.size());
+        record(gpu_decompression, mib_per_sec(gpu_data.size(), ms_since(start)));
+
+        std::vector<std::string> group_names, object_names;
+        for(size_t i = 0; i < bundle.num_groups(); ++i)
+            group_names.emplace_back(bundle.string(bundle.group_name(i)));
+        for(object_id i = 0; i < bundle.num_objects(); ++i)
+            object_names.emplace_back(bundle.string(bundle.object_name(i)));
+        record(group_lookup, time_lookups(group_names, [&](const std::string& n) {
+                   return bundle.group_by_name(n).has_value();
+               }));
+        record(object_lookup, time_lookups(object_names, [&](const std::string& n) {
+                   return bundle.object_by_name(n).has_value();
+               }));
+
+        if(bundle.num_objects() > 0) {
+            size_t repeats     = std::max<size_t>(1, 100000 / bundle.num_objects());
+            size_t index_count = 0;
+            start              = bench_clock::now();
+            for(size_t r = 0; r < repeats; ++r) {
+                for(object_id i = 0; i < bundle.num_objects(); ++i)
+                    for(auto m = bundle.object_meshes(i); m.has_more(); ++m)
+                        index_count += m->index_count;
+            }
+            record(mesh_iteration, ms_since(start) * 1e6 / (repeats * bundle.num_objects()));
+            // keep the loop from being optimized away
+            volatile size_t sink = index_count;
+            (void)sink;
+        }
+    }
+
+  public:
+    bench(std::filesystem::path location, bundle_load_options opts)
+        : location(std::move(location)), opts(std::move(opts)) {}
+
+    void run(size_t runs, bool cold_runs) {
+        // the loader logs every step, which would drown out the results
+        std::ostringstream loader_log;
+        auto*              cout_buf = std::cout.rdbuf(loader_log.rdbuf());
+        try {
+            if(cold_runs) {
+                cold = true;
+                for(size_t i = 0; i < runs; ++i) {
+                    run_once();
+                    loader_log.str("");
+                }
+            }
+            // one untimed run first so that the first warm run really is warm
+            cold = false;
+            run_once();
+            for(auto& s : warm_samples)
+                s.clear();
+            for(size_t i = 0; i < runs; ++i) {
+                run_once();
+                loader_log.str("");
+            }
+        } catch(...) {
+            std::cout.rdbuf(cout_buf);
+            throw;
+        }
+        std::cout.rdbuf(cout_buf);
+    }
+
+    void report() const {
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << std::left << std::setw(40) << "" << std::right;
+        for(const char* c : {"p50", "p90", "p99", "min", "max"})
+            std::cout << std::setw(12) << c;
+        std::cout << "\n";
+        for(size_t m = 0; m < NUM_METRICS; ++m) {
+            print_row(std::string("cold ") + metric_names[m], cold_samples[m]);
+            print_row(std::string("warm ") + metric_names[m], warm_samples[m]);
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        std::cout << "usage:\n\tbundle-bench <bundle path> [-n <runs>] [-t <decompression "
+                     "threads>] [-d <dictionary>] [--warm-only]\n";
+        return -1;
+    }
+
+    std::filesystem::path location;
+    size_t                runs = 10;
+    bundle_load_options   opts;
+    bool                  cold_runs = true;
+
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "-n" && i + 1 < argc)
+            runs = std::max(std::stoul(argv[++i]), 1ul);
+        else if(arg == "-t" && i + 1 < argc)
+            opts.decompression_threads = std::stoul(argv[++i]);
+        else if(arg == "-d" && i + 1 < argc)
+            opts.dictionary = std::make_shared<bundle_dictionary>(argv[++i]);
+        else if(arg == "--warm-only")
+            cold_runs = false;
+        else
+            location = arg;
+    }
+
+    try {
+        {
+            asset_bundle bundle{location, opts};
+            std::cout << "bundle " << location << ": " << std::filesystem::file_size(location)
+                      << " bytes, " << bundle.num_sections() << " sections, "
+                      << bundle.gpu_data_size() << " bytes of GPU data, "
+                      << bundle.num_groups() << " groups, " << bundle.num_objects()
+                      << " objects\n";
+        }
+        if(cold_runs && !drop_from_page_cache(location)) {
+            std::cout << "evicting files from the page cache is not supported here, only "
+                         "measuring warm runs\n";
+            cold_runs = false;
+        }
+        std::cout << runs << " runs\n";
+
+        bench b{location, opts};
+        b.run(runs, cold_runs);
+        b.report();
+    } catch(const std::exception& e) {
+        std::cout << "error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
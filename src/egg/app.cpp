@@ -1,4 +1,5 @@
 #include "egg/app.h"
+#include <future>
 #include <stdexcept>
 
 void app::init(std::string_view window_title) {
@@ -16,8 +17,11 @@ void app::init(std::string_view window_title) {
     world = std::make_shared<flecs::world>();
     world->set<flecs::Rest>({});
 
+    // load the assets in the background while the renderer sets up the device and pipelines
+    auto pending_assets = std::async(std::launch::async, [this] { return load_assets(); });
+
     rndr   = std::make_unique<renderer>(window, world, create_rendering_algorithm());
-    assets = load_assets();
+    assets = pending_assets.get();
     rndr->start_resource_upload(assets);
 
     inpd = std::make_unique<input_distributor>(window, rndr.get(), *world);
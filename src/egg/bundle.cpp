@@ -1,118 +1,671 @@
 #include "egg/bundle.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <condition_variable>
 #include <cstring>
-#include <fstream>
+#include <exception>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <thread>
+#include <vector>
 #define ZSTD_STATIC_LINKING_ONLY
 #include <chrono>
 #include <fs-shim.h>
+#include <lz4.h>
 #include <zstd.h>
+#ifdef _WIN32
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
 
 using asset_bundle_format::environment_header;
-using asset_bundle_format::group_header;
+using asset_bundle_format::file_header;
+using asset_bundle_format::frame_header;
 using asset_bundle_format::header;
+using asset_bundle_format::affine_transform;
+using asset_bundle_format::index_range;
 using asset_bundle_format::material_header;
 using asset_bundle_format::mesh_header;
-using asset_bundle_format::object_header;
+using asset_bundle_format::name_slot;
+using asset_bundle_format::name_table_kind;
+using asset_bundle_format::section_codec;
+using asset_bundle_format::section_header;
+using asset_bundle_format::section_type;
 using asset_bundle_format::string_header;
 using asset_bundle_format::texture_header;
 
-asset_bundle::asset_bundle(const std::filesystem::path& location) {
+// read one byte from every page in a range to fault the whole range in
+static void touch_pages(const uint8_t* data, size_t size, size_t page_size) {
+    volatile uint8_t sink = 0;
+    for(size_t i = 0; i < size; i += page_size)
+        sink = sink + data[i];
+    if(size > 0) sink = sink + data[size - 1];
+}
+
+#ifdef _WIN32
+mapped_file::mapped_file(const std::filesystem::path& location) {
+    file_handle = CreateFileW(
+        location.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if(file_handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error(
+            std::string("failed to open bundle file at: ") + path_to_string(location)
+        );
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_handle, &size);
+    len            = (size_t)size.QuadPart;
+    mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping_handle == nullptr) {
+        CloseHandle(file_handle);
+        throw std::runtime_error(
+            std::string("failed to map bundle file at: ") + path_to_string(location)
+        );
+    }
+    ptr = (const uint8_t*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if(ptr == nullptr) {
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        throw std::runtime_error(
+            std::string("failed to map bundle file at: ") + path_to_string(location)
+        );
+    }
+}
+
+void mapped_file::read(size_t offset, size_t size, uint8_t* dest) const {
+    memcpy(dest, ptr + offset, size);
+}
+
+void mapped_file::read_ahead(size_t offset, size_t size) const {
+    // the copy in read() faults the mapping in, which Windows already reads ahead for
+}
+
+void mapped_file::prefetch(size_t offset, size_t size) const {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    touch_pages(ptr + offset, size, info.dwPageSize);
+}
+
+mapped_file::~mapped_file() {
+    UnmapViewOfFile(ptr);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+}
+#else
+mapped_file::mapped_file(const std::filesystem::path& location) {
+    fd = open(path_to_string(location).c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error(
+            std::string("failed to open bundle file at: ") + path_to_string(location)
+        );
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error(
+            std::string("failed to read bundle file at: ") + path_to_string(location)
+        );
+    }
+    len        = (size_t)st.st_size;
+    void* addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(addr == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error(
+            std::string("failed to map bundle file at: ") + path_to_string(location)
+        );
+    }
+    ptr = (const uint8_t*)addr;
+    // bundles are mostly read front to back, so ask for a larger readahead window
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void mapped_file::read(size_t offset, size_t size, uint8_t* dest) const {
+    while(size > 0) {
+        ssize_t n = pread(fd, dest, size, (off_t)offset);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) throw std::runtime_error("failed to read from bundle file");
+        offset += (size_t)n;
+        dest += n;
+        size -= (size_t)n;
+    }
+}
+
+void mapped_file::read_ahead(size_t offset, size_t size) const {
+    posix_fadvise(fd, (off_t)offset, (off_t)size, POSIX_FADV_WILLNEED);
+}
+
+void mapped_file::prefetch(size_t offset, size_t size) const {
+    // start readahead for the whole range, then wait for it by faulting every page in
+    size_t page  = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset / page * page;
+    madvise((void*)(ptr + start), offset + size - start, MADV_WILLNEED);
+    touch_pages(ptr + offset, size, page);
+}
+
+mapped_file::~mapped_file() {
+    munmap((void*)ptr, len);
+    close(fd);
+}
+#endif
+
+bundle_dictionary::bundle_dictionary(const std::filesystem::path& location) {
+    mapped_file file{location};
+    id = ZSTD_getDictID_fromDict(file.data(), file.size());
+    // a dictionary without an id can't be matched to the bundles that need it
+    if(id == 0)
+        throw std::runtime_error(std::string("not a zstd dictionary: ") + path_to_string(location));
+    ddict = ZSTD_createDDict(file.data(), file.size());
+    if(ddict == nullptr)
+        throw std::runtime_error(
+            std::string("failed to load zstd dictionary at: ") + path_to_string(location)
+        );
+}
+
+bundle_dictionary::~bundle_dictionary() { ZSTD_freeDDict(ddict); }
+
+template<typename T>
+T* asset_bundle::cpu_table(uint32_t offset, size_t count) const {
+    if((size_t)offset + sizeof(T) * count > sections[0].uncompressed_size)
+        throw std::runtime_error("bundle CPU section table is out of bounds");
+    return (T*)(cpu_data.get() + offset);
+}
+
+template<typename T>
+T* asset_bundle::index_table(
+    uint32_t offset, const index_range* ranges, size_t num_ranges, size_t bound
+) const {
+    // index tables have no count of their own, they are as long as the ranges into them need
+    size_t count = 0;
+    for(size_t i = 0; i < num_ranges; ++i)
+        count = std::max(count, (size_t)ranges[i].first + ranges[i].count);
+    T* table = cpu_table<T>(offset, count);
+    for(size_t i = 0; i < count; ++i)
+        if((size_t)table[i] >= bound)
+            throw std::runtime_error("bundle CPU section index is out of range");
+    return table;
+}
+
+void asset_bundle::check_names() const {
+    for(size_t i = 0; i < header->num_strings; ++i)
+        cpu_table<char>(strings[i].offset, strings[i].len);
+
+    size_t bounds[asset_bundle_format::NUM_NAME_TABLES];
+    bounds[asset_bundle_format::group_names]    = header->num_groups;
+    bounds[asset_bundle_format::object_names]   = header->num_objects;
+    bounds[asset_bundle_format::material_names] = header->num_materials;
+    // texture names map to texture ids, which start at 1
+    bounds[asset_bundle_format::texture_names] = (size_t)header->num_textures + 1;
+    for(uint32_t kind = 0; kind < asset_bundle_format::NUM_NAME_TABLES; ++kind) {
+        const auto& table = header->name_tables[kind];
+        if(table.num_slots == 0) continue;
+        if(table.num_buckets == 0)
+            throw std::runtime_error("bundle name table has slots but no buckets");
+        cpu_table<uint32_t>(table.seeds_offset, table.num_buckets);
+        const auto* slots = cpu_table<name_slot>(table.slots_offset, table.num_slots);
+        for(uint32_t s = 0; s < table.num_slots; ++s) {
+            if(slots[s].name == INVALID_STRING) continue;
+            if(slots[s].name > header->num_strings || slots[s].index >= bounds[kind])
+                throw std::runtime_error("bundle name table slot is out of range");
+        }
+    }
+}
+
+asset_bundle::asset_bundle(
+    const std::filesystem::path& location, const bundle_load_options& options
+)
+    : file(location), options(options) {
     std::cout << "loading bundle from " << location << "...";
     auto start_read_time = std::chrono::system_clock::now();
     std::cout.flush();
-    std::ifstream file(location, std::ios::ate | std::ios::binary);
-    if(!file)
+
+    const auto* fh = (const file_header*)file.data();
+    if(file.size() < sizeof(file_header) || fh->magic != asset_bundle_format::MAGIC)
+        throw std::runtime_error(
+            std::string("invalid bundle file at: ") + path_to_string(location)
+        );
+    if(fh->version != asset_bundle_format::VERSION)
+        throw std::runtime_error(
+            "unsupported bundle version " + std::to_string(fh->version) + " (expected "
+            + std::to_string(asset_bundle_format::VERSION) + ") at: " + path_to_string(location)
+        );
+    section_count = fh->num_sections;
+    sections      = (const section_header*)(file.data() + sizeof(file_header));
+    frame_count   = fh->num_frames;
+    frames        = (const frame_header*)(sections + section_count);
+    if(section_count == 0 || fh->frame_size == 0
+       || section_count > file.size() / sizeof(section_header)
+       || frame_count > file.size() / sizeof(frame_header)
+       || file.size() < sizeof(file_header) + sizeof(section_header) * section_count
+                            + sizeof(frame_header) * frame_count
+       || sections[0].type != section_type::cpu)
+        throw std::runtime_error(
+            std::string("corrupt bundle table of contents at: ") + path_to_string(location)
+        );
+    for(size_t i = 0; i < section_count; ++i) {
+        const auto& sh = sections[i];
+        // every frame but the last one in a section is full, so the size fixes the frame count.
+        // anything else would have frames decompress past the end of the section
+        uint64_t num_frames = sh.uncompressed_size / fh->frame_size
+                              + (sh.uncompressed_size % fh->frame_size != 0 ? 1 : 0);
+        if(sh.first_frame > frame_count || sh.num_frames > frame_count - sh.first_frame
+           || sh.num_frames != num_frames || sh.codec >= section_codec::NUM_CODECS)
+            throw std::runtime_error(
+                "corrupt bundle section " + std::to_string(i) + " at: " + path_to_string(location)
+            );
+    }
+    frame_size = fh->frame_size;
+    if(fh->dictionary_id != 0) {
+        if(options.dictionary == nullptr
+           || options.dictionary->dictionary_id() != fh->dictionary_id)
+            throw std::runtime_error(
+                "bundle requires zstd dictionary " + std::to_string(fh->dictionary_id)
+                + " at: " + path_to_string(location)
+            );
+        dictionary = options.dictionary.get();
+    }
+    std::cout << " mapped " << file.size() << " bytes, " << section_count << " sections in "
+              << frame_count << " frames\n";
+
+    if(sections[0].uncompressed_size < sizeof(struct header))
+        throw std::runtime_error(
+            std::string("corrupt bundle header at: ") + path_to_string(location)
+        );
+
+    // only the CPU section is decompressed up front, GPU sections are decompressed on demand
+    // owned before anything below can throw, since the destructor won't run if the constructor does
+    cpu_data.reset((uint8_t*)malloc(sections[0].uncompressed_size));
+    if(cpu_data == nullptr)
         throw std::runtime_error(
-            std::string("failed to load bundle file at: ") + path_to_string(location)
+            "failed to allocate " + std::to_string(sections[0].uncompressed_size)
+            + " bytes for bundle CPU section at: " + path_to_string(location)
         );
-    size_t   compressed_buffer_size = (size_t)file.tellg();
-    uint8_t* compressed_buffer      = (uint8_t*)malloc(compressed_buffer_size);
-    file.seekg(0);
-    file.read((char*)compressed_buffer, compressed_buffer_size);
-    file.close();
-    std::cout << " read " << compressed_buffer_size << " bytes\n";
+    decompress_section(0, cpu_data.get(), sections[0].uncompressed_size);
     auto end_read_time = std::chrono::system_clock::now();
-    std::cout << "reading bundle took "
+    std::cout << "reading bundle metadata took "
               << std::chrono::duration_cast<std::chrono::milliseconds>(
                      end_read_time - start_read_time
                  )
                      .count()
               << "\n";
 
-    std::cout << "decompressing bundle... ";
-    std::cout.flush();
-    auto   start_decom_time = std::chrono::system_clock::now();
-    size_t size             = ZSTD_decompressBound(compressed_buffer, compressed_buffer_size);
-    bundle_data             = (uint8_t*)malloc(size);
-    total_size = ZSTD_decompress(bundle_data, size, compressed_buffer, compressed_buffer_size);
-    std::cout << " got " << total_size << " bytes\n";
-    free(compressed_buffer);
-    auto end_decom_time = std::chrono::system_clock::now();
-    std::cout << "decompressing bundle took "
-              << std::chrono::duration_cast<std::chrono::milliseconds>(
-                     end_decom_time - start_decom_time
-                 )
-                     .count()
-              << "\n";
+    header = (struct header*)cpu_data.get();
+
+    strings      = cpu_table<string_header>(header->strings_offset, header->num_strings);
+    textures     = cpu_table<texture_header>(header->textures_offset, header->num_textures);
+    // textures are found by id as an index, so the ids must run from 1 without holes
+    for(uint32_t i = 0; i < header->num_textures; ++i)
+        if(textures[i].id != i + 1)
+            throw std::runtime_error(
+                std::string("corrupt bundle texture ids at: ") + path_to_string(location)
+            );
+    environments = cpu_table<environment_header>(
+        header->environments_offset, header->num_environments
+    );
+    materials = cpu_table<material_header>(header->materials_offset, header->num_materials);
+    meshes    = cpu_table<mesh_header>(header->meshes_offset, header->num_meshes);
+
+    objects.names = cpu_table<string_id>(header->object_names_offset, header->num_objects);
+    objects.transforms
+        = cpu_table<affine_transform>(header->object_transforms_offset, header->num_objects);
+    objects.bounds = cpu_table<aabb>(header->object_bounds_offset, header->num_objects);
+    objects.meshes = cpu_table<index_range>(header->object_meshes_offset, header->num_objects);
+    object_mesh_indices = index_table<uint32_t>(
+        header->object_mesh_indices_offset, objects.meshes, header->num_objects, header->num_meshes
+    );
 
-    header              = (struct header*)bundle_data;
-    uint8_t* header_ptr = bundle_data + sizeof(asset_bundle_format::header);
-
-    // important that these are in the same order as in output_bundle::write()'s copy_X() calls
-    strings = (string_header*)header_ptr;
-    header_ptr += sizeof(string_header) * header->num_strings;
-    materials = (material_header*)header_ptr;
-    header_ptr += sizeof(material_header) * header->num_materials;
-    meshes = (mesh_header*)header_ptr;
-    header_ptr += sizeof(mesh_header) * header->num_meshes;
-    objects = (object_header*)header_ptr;
-    header_ptr += sizeof(object_header) * header->num_objects;
-    groups = (group_header*)header_ptr;
-    header_ptr += sizeof(asset_bundle_format::group_header) * header->num_groups;
-    textures = (texture_header*)header_ptr;
-    header_ptr += sizeof(texture_header) * header->num_textures;
-    environments = (environment_header*)header_ptr;
-    header_ptr += sizeof(environment_header) * header->num_environments;
-
-    std::cout << "bundle CPU data " << header->gpu_data_offset << " bytes, "
+    groups.names   = cpu_table<string_id>(header->group_names_offset, header->num_groups);
+    groups.bounds  = cpu_table<aabb>(header->group_bounds_offset, header->num_groups);
+    groups.objects = cpu_table<index_range>(header->group_objects_offset, header->num_groups);
+    group_object_indices = index_table<object_id>(
+        header->group_object_indices_offset, groups.objects, header->num_groups, header->num_objects
+    );
+
+    check_names();
+
+    std::cout << "bundle CPU data " << sections[0].uncompressed_size << " bytes, "
               << " GPU data " << gpu_data_size() << " bytes\n";
 
-    /*for(size_t i = 0; i < header->num_strings; ++i) {
-        std::cout << "string " << i
-            << "/" << strings[i].id
-            << " " << strings[i].offset
-            << ":" << strings[i].len << "\n";
+    if(options.prefetch_gpu_data) prefetch_gpu_data();
+}
+
+static ZSTD_DCtx* create_dctx(const bundle_dictionary* dictionary) {
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if(dctx == nullptr) throw std::runtime_error("failed to create zstd decompression context");
+    // bundles may be written with a larger window than zstd accepts by default
+    ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, ZSTD_WINDOWLOG_MAX);
+    // referencing the digested dictionary is cheap, so every context can share it
+    if(dictionary != nullptr) ZSTD_DCtx_refDDict(dctx, dictionary->digested());
+    return dctx;
+}
+
+// decompress one frame of a section into dest, returning the decompressed size
+static size_t decode_frame(
+    const section_header& section,
+    size_t                section_index,
+    ZSTD_DCtx*            dctx,
+    const uint8_t*        src,
+    size_t                src_size,
+    uint8_t*              dest,
+    size_t                dest_size
+) {
+    auto error = [&](const std::string& reason) {
+        return std::runtime_error(
+            "failed to decompress bundle section " + std::to_string(section_index) + ": " + reason
+        );
+    };
+    switch(section.codec) {
+        case section_codec::zstd: {
+            size_t ret = ZSTD_decompressDCtx(dctx, dest, dest_size, src, src_size);
+            if(ZSTD_isError(ret)) throw error(ZSTD_getErrorName(ret));
+            return ret;
+        }
+        case section_codec::lz4: {
+            int ret = LZ4_decompress_safe(
+                (const char*)src, (char*)dest, (int)src_size, (int)dest_size
+            );
+            if(ret < 0) throw error("invalid LZ4 block");
+            return (size_t)ret;
+        }
+        case section_codec::stored: {
+            size_t size = std::min(src_size, dest_size);
+            memcpy(dest, src, size);
+            return size;
+        }
+        default: throw error("unknown codec");
+    }
+}
+
+void asset_bundle::decompress_sections(
+    size_t first, size_t last, uint8_t* dest, size_t dest_size, size_t base_offset
+) const {
+    assert(first < last && last <= section_count);
+
+    // every frame is an independent unit of work
+    struct frame_job {
+        size_t   section, frame;
+        uint8_t* dest;
+        size_t   size;
+    };
+
+    std::vector<frame_job> jobs;
+    for(size_t i = first; i < last; ++i) {
+        const auto& sh = sections[i];
+        if(sh.gpu_offset - base_offset + sh.uncompressed_size > dest_size)
+            throw std::runtime_error(
+                "destination is too small for bundle section " + std::to_string(i)
+            );
+        for(size_t f = 0; f < sh.num_frames; ++f) {
+            size_t offset = f * frame_size;
+            jobs.emplace_back(frame_job{
+                .section = i,
+                .frame   = sh.first_frame + f,
+                .dest    = dest + (sh.gpu_offset - base_offset) + offset,
+                .size    = std::min(frame_size, sh.uncompressed_size - offset),
+            });
+        }
+    }
+    if(jobs.empty()) return;
+
+    // the compressed frames are read into a ring of buffers by a dedicated thread while the
+    // workers decompress the frames that have already arrived, so that I/O and decompression
+    // overlap. consecutive frames are read together in chunks of at least this many bytes
+    const size_t read_chunk_size = 4 * 1024 * 1024;
+    struct read_chunk {
+        size_t file_offset, size;
+        // jobs still waiting to be decompressed out of this chunk
+        size_t remaining;
+    };
+    std::vector<read_chunk> chunks;
+    std::vector<size_t>     job_chunk(jobs.size());
+    for(size_t j = 0; j < jobs.size(); ++j) {
+        const auto& fr = frames[jobs[j].frame];
+        if(fr.file_offset + fr.compressed_size > file.size())
+            throw std::runtime_error(
+                "bundle section " + std::to_string(jobs[j].section) + " is truncated"
+            );
+        if(chunks.empty() || chunks.back().size >= read_chunk_size
+           || chunks.back().file_offset + chunks.back().size != fr.file_offset)
+            chunks.emplace_back(read_chunk{.file_offset = fr.file_offset});
+        chunks.back().size += fr.compressed_size;
+        chunks.back().remaining++;
+        job_chunk[j] = chunks.size() - 1;
     }
 
-    for(size_t i = 0; i < header->num_textures; ++i) {
-        const auto& th = textures[i];
-        std::cout << "texture "
-            << " " << th.id << "|" << th.name << "|" << th.offset
-            << " " << th.width << "x" << th.height
-            << " " << (uint32_t)(th.format) << "\n";
-    }*/
+    size_t num_threads = options.decompression_threads;
+    if(num_threads == 0) num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    num_threads = std::min(num_threads, jobs.size());
+
+    // chunk c is read into buffers[c % buffers.size()] once chunk c - buffers.size() is finished
+    std::vector<std::vector<uint8_t>> buffers(std::min(num_threads + 2, chunks.size()));
+    size_t                            chunks_read = 0;
+    std::mutex                        io_mutex;
+    std::condition_variable           io_cv;
+
+    std::atomic<size_t> next_job{0};
+    std::atomic<bool>   failed{false};
+    std::vector<double> frame_times(jobs.size());
+    double              read_wait_time = 0.0;
+
+    bundle_load_progress progress{
+        .current_stage = first == 0 ? bundle_load_progress::stage::metadata
+                                    : bundle_load_progress::stage::gpu_data,
+        .done          = 0,
+        .total         = 0
+    };
+    for(const auto& job : jobs)
+        progress.total += job.size;
+    std::mutex progress_mutex;
+
+    auto fail = [&](std::exception_ptr& error) {
+        error = std::current_exception();
+        std::lock_guard lock{io_mutex};
+        failed = true;
+        io_cv.notify_all();
+    };
+
+    auto reader = [&](std::exception_ptr& reader_error) {
+        try {
+            for(size_t c = 0; c < chunks.size(); ++c) {
+                {
+                    std::unique_lock lock{io_mutex};
+                    io_cv.wait(lock, [&] {
+                        return failed || c < buffers.size()
+                               || chunks[c - buffers.size()].remaining == 0;
+                    });
+                    if(failed) return;
+                }
+                if(c + 1 < chunks.size())
+                    file.read_ahead(chunks[c + 1].file_offset, chunks[c + 1].size);
+                auto& buffer = buffers[c % buffers.size()];
+                buffer.resize(chunks[c].size);
+                file.read(chunks[c].file_offset, chunks[c].size, buffer.data());
+                std::lock_guard lock{io_mutex};
+                chunks_read = c + 1;
+                io_cv.notify_all();
+            }
+        } catch(...) {
+            fail(reader_error);
+        }
+    };
+
+    auto worker = [&](std::exception_ptr& worker_error) {
+        ZSTD_DCtx* dctx      = nullptr;
+        double     wait_time = 0.0;
+        try {
+            dctx = create_dctx(dictionary);
+            for(size_t j = next_job++; j < jobs.size() && !failed; j = next_job++) {
+                const auto& job = jobs[j];
+                const auto& fr  = frames[job.frame];
+                size_t      c   = job_chunk[j];
+                {
+                    auto             wait_start = std::chrono::steady_clock::now();
+                    std::unique_lock lock{io_mutex};
+                    io_cv.wait(lock, [&] { return failed || chunks_read > c; });
+                    if(failed) break;
+                    std::chrono::duration<double, std::milli> waited
+                        = std::chrono::steady_clock::now() - wait_start;
+                    wait_time += waited.count();
+                }
+                const uint8_t* src = buffers[c % buffers.size()].data()
+                                     + (fr.file_offset - chunks[c].file_offset);
+                auto   start = std::chrono::steady_clock::now();
+                size_t ret   = decode_frame(
+                    sections[job.section],
+                    job.section,
+                    dctx,
+                    src,
+                    fr.compressed_size,
+                    job.dest,
+                    job.size
+                );
+                if(ret != job.size)
+                    throw std::runtime_error(
+                        "bundle section " + std::to_string(job.section)
+                        + " decompressed to an unexpected size"
+                    );
+                auto end       = std::chrono::steady_clock::now();
+                frame_times[j] = std::chrono::duration<double, std::milli>(end - start).count();
+                {
+                    // the last frame out of a chunk frees its buffer for the reader
+                    std::lock_guard lock{io_mutex};
+                    if(--chunks[c].remaining == 0) io_cv.notify_all();
+                }
+                if(options.progress) {
+                    std::lock_guard lock{progress_mutex};
+                    progress.done += job.size;
+                    options.progress(progress);
+                }
+            }
+        } catch(...) {
+            fail(worker_error);
+        }
+        ZSTD_freeDCtx(dctx);
+        std::lock_guard lock{progress_mutex};
+        read_wait_time += wait_time;
+    };
+
+    // the calling thread works too, so only num_threads - 1 extra threads are needed
+    // errors[0] is for the reader
+    std::vector<std::exception_ptr> errors(num_threads + 1);
+    std::vector<std::thread>        threads;
+    threads.reserve(num_threads);
+    threads.emplace_back(reader, std::ref(errors[0]));
+    for(size_t t = 2; t <= num_threads; ++t)
+        threads.emplace_back(worker, std::ref(errors[t]));
+    worker(errors[1]);
+    for(auto& t : threads)
+        t.join();
+    for(const auto& e : errors)
+        if(e) std::rethrow_exception(e);
+
+    double min_time = frame_times[0], max_time = 0.0, total_time = 0.0;
+    size_t slowest = 0;
+    for(size_t j = 0; j < frame_times.size(); ++j) {
+        min_time = std::min(min_time, frame_times[j]);
+        if(frame_times[j] > max_time) {
+            max_time = frame_times[j];
+            slowest  = j;
+        }
+        total_time += frame_times[j];
+    }
+    std::cout << "\tdecompressed " << jobs.size() << " frames on " << num_threads
+              << " threads, per frame min/avg/max " << min_time << "/"
+              << total_time / jobs.size() << "/" << max_time << " ms (slowest in section "
+              << jobs[slowest].section << "), waited " << read_wait_time << " ms for "
+              << chunks.size() << " reads\n";
+
+    // decode rate of each codec on one thread, so that codecs can be compared across machines
+    double codec_time[(size_t)section_codec::NUM_CODECS]  = {};
+    size_t codec_bytes[(size_t)section_codec::NUM_CODECS] = {};
+    for(size_t j = 0; j < jobs.size(); ++j) {
+        auto codec = (size_t)sections[jobs[j].section].codec;
+        codec_time[codec] += frame_times[j];
+        codec_bytes[codec] += jobs[j].size;
+    }
+    for(size_t c = 0; c < (size_t)section_codec::NUM_CODECS; ++c) {
+        if(codec_bytes[c] == 0) continue;
+        double mib = (double)codec_bytes[c] / (1024.0 * 1024.0);
+        std::cout << "\t" << asset_bundle_format::SECTION_CODEC_NAMES[c] << ": " << mib
+                  << " MiB at " << mib / std::max(codec_time[c] / 1000.0, 1e-9)
+                  << " MiB/s per thread\n";
+    }
 }
 
-asset_bundle::~asset_bundle() { free(bundle_data); }
+void asset_bundle::decompress_section(size_t i, uint8_t* dest, size_t dest_size) const {
+    assert(i < section_count);
+    decompress_sections(i, i + 1, dest, dest_size, sections[i].gpu_offset);
+}
 
-void asset_bundle::take_gpu_data(uint8_t* dest) {
-    assert(!gpu_data_taken);
-    memcpy(dest, bundle_data + header->gpu_data_offset, gpu_data_size());
-    bundle_data    = (uint8_t*)realloc(bundle_data, header->gpu_data_offset);
-    gpu_data_taken = true;
+void asset_bundle::decompress_gpu_data(uint8_t* dest, size_t dest_size) const {
+    if(dest_size < gpu_data_size())
+        throw std::runtime_error("destination is too small for bundle GPU data");
+    if(section_count < 2) return;
+    std::cout << "decompressing bundle GPU data...\n";
+    auto start_decom_time = std::chrono::system_clock::now();
+    decompress_sections(1, section_count, dest, dest_size, 0);
+    auto end_decom_time = std::chrono::system_clock::now();
+    auto ms
+        = std::chrono::duration_cast<std::chrono::milliseconds>(end_decom_time - start_decom_time)
+              .count();
+    std::cout << "decompressing bundle took " << ms << " ("
+              << (double)gpu_data_size() / (1024.0 * 1024.0) / std::max(ms / 1000.0, 0.001)
+              << " MiB/s)\n";
 }
 
-std::string_view asset_bundle::string(string_id id) const {
-    auto* sh = strings + (id - 1);
-    // std::cout << "string " << id
-    //         << "/" << sh->id
-    //         << " " << sh->offset
-    //         << ":" << sh->len << "\n";
+void asset_bundle::prefetch_gpu_data() const {
+    // the GPU frames are stored back to back after the last frame of the CPU section
+    const auto& last_cpu_frame = frames[sections[0].first_frame + sections[0].num_frames - 1];
+    size_t      start          = last_cpu_frame.file_offset + last_cpu_frame.compressed_size;
+    if(start >= file.size()) return;
 
-    assert(sh->id == id);
-    return {(char*)(bundle_data + sh->offset), sh->len};
+    // prefetch in chunks so progress can be reported along the way
+    const size_t         chunk_size = 4 * 1024 * 1024;
+    bundle_load_progress progress{
+        .current_stage = bundle_load_progress::stage::prefetch,
+        .done          = 0,
+        .total         = file.size() - start
+    };
+    auto start_time = std::chrono::system_clock::now();
+    while(progress.done < progress.total) {
+        size_t size = std::min(chunk_size, progress.total - progress.done);
+        file.prefetch(start + progress.done, size);
+        progress.done += size;
+        if(options.progress) options.progress(progress);
+    }
+    auto end_time = std::chrono::system_clock::now();
+    std::cout << "prefetching " << progress.total << " bytes of bundle GPU data took "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time)
+                     .count()
+              << "\n";
+}
+
+std::future<std::shared_ptr<asset_bundle>> load_bundle_async(
+    std::filesystem::path location, bundle_load_options options
+) {
+    return std::async(
+        std::launch::async,
+        [location = std::move(location), options = std::move(options)]() {
+            return std::make_shared<asset_bundle>(location, options);
+        }
+    );
+}
+
+std::string_view asset_bundle::string(string_id id) const {
+    assert(id != INVALID_STRING && id <= header->num_strings);
+    const auto& sh = strings[id - 1];
+    return {(char*)(cpu_data.get() + sh.offset), sh.len};
 }
 
 const texture_header& asset_bundle::texture(texture_id id) const {
@@ -123,45 +676,66 @@ const texture_header& asset_bundle::texture(texture_id id) const {
 
 const texture_header& asset_bundle::texture_by_index(size_t i) const { return *(textures + i); }
 
+std::optional<texture_id> asset_bundle::texture_by_name(std::string_view name) const {
+    return find_name(asset_bundle_format::texture_names, name);
+}
+
 const environment_header& asset_bundle::environment_by_index(size_t i) const {
     return *(environments + i);
 }
 
 #include <glm/gtx/io.hpp>
 
-const glm::mat4& asset_bundle::object_transform(object_id id) const {
-    // std::cout << "static transform for " << id << ": " << objects[id].transform_matrix << "\n";
-    return objects[id].transform_matrix;
+glm::mat4 asset_bundle::object_transform(object_id id) const {
+    // std::cout << "static transform for " << id << ": " << objects.transforms[id] << "\n";
+    return glm::mat4(objects.transforms[id]);
 }
 
 object_mesh_iterator asset_bundle::object_meshes(object_id id) const {
-    return object_mesh_iterator{
-        meshes, (uint32_t*)(bundle_data + objects[id].offset), objects[id].num_meshes
-    };
+    const auto& r = objects.meshes[id];
+    return object_mesh_iterator{meshes, object_mesh_indices + r.first, r.count};
 }
 
-string_id asset_bundle::object_name(object_id id) const { return objects[id].name; }
+string_id asset_bundle::object_name(object_id id) const { return objects.names[id]; }
 
-const aabb& asset_bundle::object_bounds(object_id id) const { return objects[id].bounds; }
+const aabb& asset_bundle::object_bounds(object_id id) const { return objects.bounds[id]; }
+
+std::optional<object_id> asset_bundle::object_by_name(std::string_view name) const {
+    return find_name(asset_bundle_format::object_names, name);
+}
 
 const asset_bundle_format::material_header& asset_bundle::material(size_t index) const {
     return materials[index];
 }
 
-string_id asset_bundle::group_name(size_t group_index) const { return groups[group_index].name; }
+std::optional<size_t> asset_bundle::material_by_name(std::string_view name) const {
+    return find_name(asset_bundle_format::material_names, name);
+}
+
+string_id asset_bundle::group_name(size_t group_index) const { return groups.names[group_index]; }
 
 const aabb& asset_bundle::group_bounds(size_t group_index) const {
-    return groups[group_index].bounds;
+    return groups.bounds[group_index];
 }
 
 group_object_iterator asset_bundle::group_objects(size_t group_index) const {
-    return group_object_iterator{
-        (uint32_t*)(bundle_data + groups[group_index].offset), groups[group_index].num_objects
-    };
+    const auto& r = groups.objects[group_index];
+    return group_object_iterator{group_object_indices + r.first, r.count};
 }
 
 std::optional<size_t> asset_bundle::group_by_name(std::string_view name) const {
-    for(size_t i = 0; i < header->num_groups; ++i)
-        if(string(groups[i].name) == name) return i;
-    return std::nullopt;
+    return find_name(asset_bundle_format::group_names, name);
+}
+
+std::optional<uint32_t> asset_bundle::find_name(name_table_kind kind, std::string_view name) const {
+    const auto& table = header->name_tables[kind];
+    if(table.num_slots == 0) return std::nullopt;
+    auto        h     = asset_bundle_format::hash_name(name);
+    auto*       seeds = cpu_table<uint32_t>(table.seeds_offset, table.num_buckets);
+    auto*       slots = cpu_table<name_slot>(table.slots_offset, table.num_slots);
+    auto        seed  = seeds[h % table.num_buckets];
+    const auto& slot  = slots[asset_bundle_format::name_slot_hash(h, seed) % table.num_slots];
+    // names that are not in the table can still land on an occupied slot
+    if(slot.name == INVALID_STRING || string(slot.name) != name) return std::nullopt;
+    return slot.index;
 }
@@ -151,20 +151,35 @@ void forward_rendering_algorithm::create_pipeline_layouts(
     });
 }
 
-void forward_rendering_algorithm::create_pipelines() {
+void forward_rendering_algorithm::create_pipelines(asset_bundle_format::vertex_format vertices) {
     if(!vertex_shader) vertex_shader = device.createShaderModuleUnique(vertex_shader_create_info);
     if(!fragment_shader)
         fragment_shader = device.createShaderModuleUnique(fragment_shader_create_info);
 
+    // the vertex shader decodes quantized vertices when its first specialization constant is set
+    bool     quantized          = vertices == asset_bundle_format::vertex_format::quantized;
+    VkBool32 quantized_vertices = quantized ? VK_TRUE : VK_FALSE;
+
+    vk::SpecializationMapEntry quantized_entry{0, 0, sizeof(VkBool32)};
+    vk::SpecializationInfo     vertex_specialization{
+        1, &quantized_entry, sizeof(VkBool32), &quantized_vertices
+    };
+
     vk::PipelineShaderStageCreateInfo shader_stages[] = {
         {{}, vk::ShaderStageFlagBits::eVertex,   vertex_shader.get(),   "main"},
         {{}, vk::ShaderStageFlagBits::eFragment, fragment_shader.get(), "main"}
     };
+    shader_stages[0].setPSpecializationInfo(&vertex_specialization);
 
-    auto vertex_binding
-        = vk::VertexInputBindingDescription{0, sizeof(vertex), vk::VertexInputRate::eVertex};
+    auto vertex_binding = vk::VertexInputBindingDescription{
+        0, quantized ? sizeof(quantized_vertex) : sizeof(vertex), vk::VertexInputRate::eVertex
+    };
     auto vertex_input_info = vk::PipelineVertexInputStateCreateInfo{
-        {}, 1, &vertex_binding, 4, vertex_attribute_description
+        {},
+        1,
+        &vertex_binding,
+        4,
+        quantized ? quantized_vertex_attribute_description : vertex_attribute_description
     };
 
     auto input_assembly
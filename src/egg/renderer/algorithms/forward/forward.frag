@@ -1,6 +1,7 @@
 #version 450core
 #include "scene_data.h"
 #include "pbr_brdf.h"
+#include "sh_irradiance.h"
 
 layout(location = 0) in VertexOutput {
     vec3 positionW;
@@ -24,7 +25,7 @@ vec3 linearToSrgb(vec3 linearColor) {
 }
 
 void main() {
-    if(uint(object.base_color) == 65535) {
+    if(uint(object.base_color) == NO_TEXTURE) {
         final_color = vec4(0.01, 0.01, 0.01, 0.5);
         return;
     }
@@ -33,16 +34,26 @@ void main() {
 
     vec4 base_color = texture(textures[uint(object.base_color)], finput.tex_coord);
     base_color.xyz = pow(base_color.xyz, vec3(2.2));
-    // TODO: these should really be in the same texture map
-    float roughness = texture(textures[uint(object.roughness)], finput.tex_coord).x;
-    float metallic  = texture(textures[uint(object.metallic)], finput.tex_coord).x;
-    vec3 normN = normalize(texture(textures[uint(object.normals)], finput.tex_coord).xyz * 2.0 - 1.0);
+    // materials without an ORM texture get the same defaults the bundler packs for missing maps:
+    // no occlusion, fully rough and not metallic
+    vec3 orm = vec3(1.0, 1.0, 0.0);
+    if(uint(object.orm) != NO_TEXTURE)
+        orm = texture(textures[uint(object.orm)], finput.tex_coord).xyz;
+    float occlusion = orm.x, roughness = orm.y, metallic = orm.z;
+    // normal maps may be BC5 compressed, which only keeps X and Y, so Z is always reconstructed
+    vec3 normN = vec3(0.0, 0.0, 1.0);
+    if(uint(object.normals) != NO_TEXTURE) {
+        vec2 nXY = texture(textures[uint(object.normals)], finput.tex_coord).xy * 2.0 - 1.0;
+        normN = vec3(nXY, sqrt(max(0.0, 1.0 - dot(nXY, nXY))));
+    }
 
     vec3 N = normalize(finput.normal_to_world * normN);
 
     vec3 F0 = compute_F0(base_color.xyz, metallic);
 
-    vec3 color = vec3(0.0003) * base_color.xyz;
+    // diffuse ambient light from the environment, less what metals and Fresnel reflect specularly
+    vec3 ambient_kD = (1.0 - F0) * (1.0 - metallic);
+    vec3 color = ambient_kD * base_color.xyz * sh_irradiance(env_irradiance_sh, N) * occlusion;
 
     vec3 L = vec3(1.0, 0.0, 0.0), radiance = vec3(100.0, 0.0, 100.0);
     for(uint i = lights.min_index; i < lights.max_index; ++i) {
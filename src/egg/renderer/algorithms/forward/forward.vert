@@ -12,12 +12,20 @@ void main() {
     voutput.tex_coord = tex_coord;
     mat4 MtoW = object_model_to_world();
 
-    vec3 tW = normalize(vec3(MtoW * vec4(tangentM, 0.0)));
-    vec3 nW = normalize(vec3(MtoW * vec4(normalM, 0.0)));
+    vec3 p = positionM, n = normalM, t = tangentM;
+    if(quantized_vertices) {
+        for(int i = 0; i < 3; ++i)
+            p[i] = object.position_min[i] + positionM[i] * object.position_extent[i];
+        n = decode_octahedral(normalM.xy);
+        t = decode_octahedral(tangentM.xy);
+    }
+
+    vec3 tW = normalize(vec3(MtoW * vec4(t, 0.0)));
+    vec3 nW = normalize(vec3(MtoW * vec4(n, 0.0)));
     vec3 bW = normalize(cross(nW, tW));
     voutput.normal_to_world = mat3(tW, bW, nW);
 
-    vec4 posW =  MtoW * vec4(positionM, 1.0);
+    vec4 posW =  MtoW * vec4(p, 1.0);
     voutput.positionW = posW.xyz;
 
 // TODO: what if it isn't the camera that is wrong, but the MtoW matrix instead???
@@ -66,6 +66,8 @@ void renderer::init_device(vk::Instance instance) {
         .storagePushConstant16 = VK_TRUE
     };
     vk::PhysicalDeviceFeatures2 device_features{{}, &v11_features};
+    // bundles may contain BC compressed textures
+    device_features.features.textureCompressionBC = VK_TRUE;
 
     const char* layer_names[] = {
 #ifndef NDEBUG
@@ -181,7 +181,10 @@ gpu_static_scene_data::gpu_static_scene_data(
     );
     staging_buffer->set_debug_name(r->vulkan_instance(), r->device(), "staging buffer");
 
-    bundle->take_gpu_data((uint8_t*)staging_buffer->cpu_mapped());
+    // decompress the bundle's GPU data straight into the staging buffer
+    bundle->decompress_gpu_data(
+        (uint8_t*)staging_buffer->cpu_mapped(), bundle->gpu_data_size() + CUBE_TOTAL_SIZE
+    );
 
     // generate skybox geometry
     uint8_t* cube_ptr = (uint8_t*)staging_buffer->cpu_mapped() + bundle->gpu_data_size();
@@ -222,7 +225,10 @@ void gpu_static_scene_data::load_geometry_from_bundle(
     auto allocator = r->gpu_alloc();
 
     const auto& bh          = current_bundle->bundle_header();
-    auto        vertex_size = bh.num_total_vertices * sizeof(vertex);
+    auto        vertex_size = bh.num_total_vertices
+                       * (bh.vertex_layout == asset_bundle_format::vertex_format::quantized
+                              ? sizeof(quantized_vertex)
+                              : sizeof(vertex));
     vertex_buffer           = std::make_unique<gpu_buffer>(
         allocator,
         vk::BufferCreateInfo{
@@ -238,27 +244,38 @@ void gpu_static_scene_data::load_geometry_from_bundle(
     upload_cmds.copyBuffer(
         staging_buffer->get(),
         vertex_buffer->get(),
-        vk::BufferCopy{bh.vertex_start_offset - bh.gpu_data_offset, 0, vertex_size}
-    );
-
-    auto index_size = bh.num_total_indices * sizeof(index_type);
-    index_buffer    = std::make_unique<gpu_buffer>(
-        allocator,
-        vk::BufferCreateInfo{
-               {},
-            index_size,
-            vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst
-        },
-        VmaAllocationCreateInfo{
-               .usage = VMA_MEMORY_USAGE_AUTO,
-        }
+        vk::BufferCopy{bh.vertex_start_offset, 0, vertex_size}
+    );
+
+    // there are separate pools for 32-bit and 16-bit indices, either of which may be empty
+    auto create_index_buffer = [&](size_t size, uint64_t start_offset, const char* name) {
+        if(size == 0) return std::unique_ptr<gpu_buffer>();
+        auto buf = std::make_unique<gpu_buffer>(
+            allocator,
+            vk::BufferCreateInfo{
+                {},
+                size,
+                vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst
+            },
+            VmaAllocationCreateInfo{
+                .usage = VMA_MEMORY_USAGE_AUTO,
+            }
+        );
+        buf->set_debug_name(r->vulkan_instance(), r->device(), name);
+        upload_cmds.copyBuffer(
+            staging_buffer->get(), buf->get(), vk::BufferCopy{start_offset, 0, size}
+        );
+        return buf;
+    };
+    index_buffer = create_index_buffer(
+        bh.num_total_indices * sizeof(index_type),
+        bh.index_start_offset,
+        "scene static index buffer"
     );
-    index_buffer->set_debug_name(r->vulkan_instance(), r->device(), "scene static index buffer");
-
-    upload_cmds.copyBuffer(
-        staging_buffer->get(),
-        index_buffer->get(),
-        vk::BufferCopy{bh.index_start_offset - bh.gpu_data_offset, 0, index_size}
+    short_index_buffer = create_index_buffer(
+        bh.num_total_short_indices * sizeof(short_index_type),
+        bh.short_index_start_offset,
+        "scene static 16-bit index buffer"
     );
 
     cube_vertex_buffer = std::make_unique<gpu_buffer>(
@@ -393,7 +410,7 @@ void gpu_static_scene_data::generate_upload_commands_for_texture(
     const asset_bundle_format::image& img,
     size_t                            bundle_offset
 ) const {
-    size_t offset  = bundle_offset - current_bundle->bundle_header().gpu_data_offset;
+    size_t offset  = bundle_offset;
     auto   regions = copy_regions_for_linear_image2d(
         img.width, img.height, img.mip_levels, img.array_layers, (vk::Format)img.format, offset
     );
@@ -424,7 +441,11 @@ void gpu_static_scene_data::generate_upload_commands_for_textures(
         const auto& th = current_bundle->texture_by_index(i);
 
         generate_upload_commands_for_texture(
-            current_bundle, upload_cmds, textures.at(th.id), th.img, th.offset
+            current_bundle,
+            upload_cmds,
+            textures.at(th.id),
+            th.img,
+            current_bundle->section(th.section).gpu_offset
         );
     }
 
@@ -441,14 +462,11 @@ void gpu_static_scene_data::generate_upload_commands_for_textures(
 void gpu_static_scene_data::create_envs_from_bundle(renderer* r, asset_bundle* current_bundle) {
     for(size_t i = 0; i < current_bundle->num_environments(); ++i) {
         const auto& ev = current_bundle->environment_by_index(i);
-        envs.emplace(
-            ev.name,
-            environment{
-                .sky                = texture{r, ev.skybox,             vk::ImageViewType::eCube},
-                .diffuse_irradiance = texture{r, ev.diffuse_irradiance, vk::ImageViewType::eCube}
-        }
-        );
-        current_env = ev.name;
+        envs.emplace_back(environment{
+            .sky                   = texture{r, ev.skybox, vk::ImageViewType::eCube},
+            .diffuse_irradiance_sh = std::to_array(ev.diffuse_irradiance_sh)
+        });
+        current_env = i;
     }
 }
 
@@ -457,12 +475,8 @@ void gpu_static_scene_data::generate_upload_commands_for_envs(
 ) {
     std::vector<vk::ImageMemoryBarrier> undef_to_transfer_barriers,
         transfer_to_shader_read_barriers;
-    for(const auto& [_, ev] : envs) {
+    for(const auto& ev : envs)
         gen_transfer_barriers(ev.sky, undef_to_transfer_barriers, transfer_to_shader_read_barriers);
-        gen_transfer_barriers(
-            ev.diffuse_irradiance, undef_to_transfer_barriers, transfer_to_shader_read_barriers
-        );
-    }
 
     upload_cmds.pipelineBarrier(
         vk::PipelineStageFlagBits::eTransfer,
@@ -474,17 +488,11 @@ void gpu_static_scene_data::generate_upload_commands_for_envs(
     );
 
     for(size_t i = 0; i < current_bundle->num_environments(); ++i) {
-        const auto& ev = current_bundle->environment_by_index(i);
+        const auto& ev             = current_bundle->environment_by_index(i);
+        auto        section_offset = current_bundle->section(ev.section).gpu_offset;
 
         generate_upload_commands_for_texture(
-            current_bundle, upload_cmds, envs.at(ev.name).sky, ev.skybox, ev.skybox_offset
-        );
-        generate_upload_commands_for_texture(
-            current_bundle,
-            upload_cmds,
-            envs.at(ev.name).diffuse_irradiance,
-            ev.diffuse_irradiance,
-            ev.diffuse_irradiance_offset
+            current_bundle, upload_cmds, envs.at(i).sky, ev.skybox, section_offset
         );
     }
 
@@ -615,13 +623,12 @@ void gpu_static_scene_data::texture_window_gui(
         }
 
         if(ImGui::BeginTabItem("Materials")) {
-            if(ImGui::BeginTable("#MaterialTable", 6, ImGuiTableFlags_Resizable)) {
+            if(ImGui::BeginTable("#MaterialTable", 5, ImGuiTableFlags_Resizable)) {
                 ImGui::TableSetupColumn("Name");
                 ImGui::TableSetupColumn("Texture IDs");
                 ImGui::TableSetupColumn("Base Color");
                 ImGui::TableSetupColumn("Normals");
-                ImGui::TableSetupColumn("Roughness");
-                ImGui::TableSetupColumn("Metallic");
+                ImGui::TableSetupColumn("Occlusion/Roughness/Metallic");
                 ImGui::TableHeadersRow();
                 for(size_t i = 0; i < current_bundle->num_materials(); ++i) {
                     const auto& m = current_bundle->material(i);
@@ -632,9 +639,10 @@ void gpu_static_scene_data::texture_window_gui(
                     ImGui::Text("%s", name.c_str());
                     ImGui::TableNextColumn();
                     ImGui::Text(
-                        "B%u N%u R%u M%u", m.base_color, m.normals, m.roughness, m.metallic
+                        "B%u N%u ORM%u", m.base_color, m.normals, m.occlusion_roughness_metallic
                     );
-                    for(texture_id id : {m.base_color, m.normals, m.roughness, m.metallic}) {
+                    for(texture_id id :
+                        {m.base_color, m.normals, m.occlusion_roughness_metallic}) {
                         ImGui::TableNextColumn();
                         auto bc = textures.find(id);
                         if(bc != textures.end())
@@ -689,7 +697,7 @@ void gpu_static_scene_data::texture_window_gui(
                                 if(ImGui::TreeNodeEx(
                                        (void*)id,
                                        ImGuiTreeNodeFlags_Leaf,
-                                       "mesh [V@%lx I@%lx:%lx M%lu, (%f,%f,%f):(%f,%f,%f)]",
+                                       "mesh [V@%x I@%x:%x M%u, (%f,%f,%f):(%f,%f,%f)]",
                                        m->vertex_offset,
                                        m->index_offset,
                                        m->index_count,
@@ -718,17 +726,21 @@ void gpu_static_scene_data::texture_window_gui(
             if(ImGui::BeginTable("#env-table", 3)) {
                 ImGui::TableSetupColumn("Name");
                 ImGui::TableSetupColumn("Skybox");
-                ImGui::TableSetupColumn("Diffuse Irradiance Map");
+                ImGui::TableSetupColumn("Diffuse Irradiance SH");
                 ImGui::TableHeadersRow();
-                for(const auto& [name, ev] : envs) {
+                for(size_t i = 0; i < envs.size(); ++i) {
+                    const auto& ev = envs[i];
                     ImGui::TableNextRow();
                     ImGui::TableNextColumn();
-                    auto name_s = std::string(current_bundle->string(name));
+                    auto name_s = std::string(
+                        current_bundle->string(current_bundle->environment_by_index(i).name)
+                    );
                     ImGui::Text("%s", name_s.c_str());
                     ImGui::TableNextColumn();
                     ImGui::Image((ImTextureID)ev.sky.imgui_id, ImVec2(256, 256));
                     ImGui::TableNextColumn();
-                    ImGui::Image((ImTextureID)ev.diffuse_irradiance.imgui_id, ImVec2(256, 256));
+                    for(const auto& c : ev.diffuse_irradiance_sh)
+                        ImGui::Text("%.3f %.3f %.3f", c.r, c.g, c.b);
                 }
                 ImGui::EndTable();
             }
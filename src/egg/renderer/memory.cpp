@@ -1,5 +1,6 @@
 #include "egg/renderer/memory.h"
 #include "error.h"
+#include <vulkan/vulkan_format_traits.hpp>
 
 gpu_buffer::gpu_buffer(
     std::shared_ptr<gpu_allocator> allocator,
@@ -63,6 +64,12 @@ void gpu_image::set_debug_name(vk::Instance inst, vk::Device dev, std::string&&
 
 #include <vulkan/vulkan_format_traits.hpp>
 
+size_t image_level_size_in_bytes(uint32_t width, uint32_t height, vk::Format format) {
+    auto block = vk::blockExtent(format);
+    return (size_t)((width + block[0] - 1) / block[0]) * ((height + block[1] - 1) / block[1])
+           * vk::blockSize(format);
+}
+
 std::vector<vk::BufferImageCopy> copy_regions_for_linear_image2d(
     uint32_t   width,
     uint32_t   height,
@@ -88,7 +95,7 @@ std::vector<vk::BufferImageCopy> copy_regions_for_linear_image2d(
                 vk::Offset3D{0, 0, 0},
                 vk::Extent3D{w, h, 1},
             });
-            offset += w * h * vk::blockSize(format);
+            offset += image_level_size_in_bytes(w, h, format);
             w = std::max(w / 2, 1u);
             h = std::max(h / 2, 1u);
         }
@@ -268,7 +268,7 @@ rendering_algorithm* scene_renderer::swap_rendering_algorithm(rendering_algorith
     std::cout << "\tcreating pipeline layouts\n";
     algo->create_pipeline_layouts(scene_data->desc_set_layout.get(), scene_data_push_consts);
     std::cout << "\tcreating pipelines\n";
-    algo->create_pipelines();
+    algo->create_pipelines(current_bundle->bundle_header().vertex_layout);
     std::cout << "\tcreating framebuffers\n";
     algo->create_framebuffers(r->fr);
     should_regenerate_command_buffer = true;
@@ -299,6 +299,10 @@ void scene_renderer::setup_scene_post_upload() {
         &transforms_buffer_info
     );
 
+    const auto& env = scene_data->envs.at(scene_data->current_env);
+    for(size_t i = 0; i < env.diffuse_irradiance_sh.size(); ++i)
+        shader_uniforms->env_irradiance_sh[i] = vec4(env.diffuse_irradiance_sh[i], 0.f);
+
     vk::DescriptorBufferInfo uniforms_buffer_info{shader_uniforms.get(), 0, VK_WHOLE_SIZE};
     writes.emplace_back(
         scene_data->desc_set,
@@ -325,7 +329,7 @@ void scene_renderer::setup_scene_post_upload() {
 
     algo->create_pipeline_layouts(scene_data->desc_set_layout.get(), scene_data_push_consts);
 
-    algo->create_pipelines();
+    algo->create_pipelines(current_bundle->bundle_header().vertex_layout);
 }
 
 void scene_renderer::resource_upload_cleanup() { scene_data->resource_upload_cleanup(); }
@@ -343,9 +347,15 @@ void scene_renderer::create_swapchain_depd(frame_renderer* fr) {
     should_regenerate_command_buffer = true;
 }
 
+// bundle texture ids start at 1, while the scene's texture descriptors start at 0
+static texture_id texture_index(texture_id id) {
+    return id == INVALID_TEXTURE ? NO_TEXTURE_INDEX : static_cast<texture_id>(id - 1);
+}
+
 void scene_renderer::generate_scene_draw_commands(vk::CommandBuffer cb, vk::PipelineLayout pl) {
     cb.bindVertexBuffers(0, scene_data->vertex_buffer->get(), {0});
-    cb.bindIndexBuffer(scene_data->index_buffer->get(), 0, vk::IndexType::eUint32);
+    // meshes are drawn from whichever index pool they are in, rebinding only when that changes
+    uint32_t bound_index_size = 0;
     active_camera_q.each([&](flecs::iter&,
                              size_t,
                              tag::active_camera,
@@ -362,16 +372,29 @@ void scene_renderer::generate_scene_draw_commands(vk::CommandBuffer cb, vk::Pipe
         [&](flecs::iter&, size_t i, const comp::gpu_transform& t, const comp::renderable& r) {
             for(auto mi = current_bundle->object_meshes(r.object); mi.has_more(); ++mi) {
                 const auto& mat = current_bundle->material(mi->material_index);
+                if(mi->index_size != bound_index_size) {
+                    if(mi->index_size == sizeof(short_index_type))
+                        cb.bindIndexBuffer(
+                            scene_data->short_index_buffer->get(), 0, vk::IndexType::eUint16
+                        );
+                    else
+                        cb.bindIndexBuffer(
+                            scene_data->index_buffer->get(), 0, vk::IndexType::eUint32
+                        );
+                    bound_index_size = mi->index_size;
+                }
+                vec3 size = mi->bounds.max - mi->bounds.min;
                 cb.pushConstants<per_object_push_constants>(
                     pl,
                     vk::ShaderStageFlagBits::eAll,
                     2 * sizeof(uint32_t),
                     {
                         {.transform_index = (uint32_t)t.gpu_index,
-                         .base_color      = static_cast<texture_id>(mat.base_color - 1),
-                         .normals         = static_cast<texture_id>(mat.normals - 1),
-                         .roughness       = static_cast<texture_id>(mat.roughness - 1),
-                         .metallic        = static_cast<texture_id>(mat.metallic - 1)}
+                         .base_color      = texture_index(mat.base_color),
+                         .normals         = texture_index(mat.normals),
+                         .orm             = texture_index(mat.occlusion_roughness_metallic),
+                         .position_min    = {mi->bounds.min.x, mi->bounds.min.y, mi->bounds.min.z},
+                         .position_extent = {size.x, size.y, size.z}}
                 }
                 );
                 cb.drawIndexed(mi->index_count, 1, mi->index_offset, mi->vertex_offset, 0);